@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+""" Micro-benchmark for the per-call overhead of Trace32API, run against the
+stand-in library in stub_t32api.c (so that only the Python side is measured).
+Reports the cost of failed calls (error-code lookup and exception mapping)
+and of small memory accesses, through ctypes and through the native
+extension (if it's been built).
+
+The 'baseline' column reproduces the error mapping from before the lookup
+tables were added: confirm_success() built list(Errcode) on every call, and
+ApiError scanned Errcode for a matching member. """
+
+import argparse
+import os
+import sys
+import timeit
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), ".."))
+
+# pylint: disable=wrong-import-position
+from trace32_cli.t32api import Trace32API, ApiError, CallFailure
+from trace32_cli.t32api import CommunicationError, Errcode
+
+# --------------------------------------------------------------------------- #
+
+FAIL_COMMUNICATION = 0xDEAD0000
+FAIL_CALL = 0xBEEF0000
+
+
+def baseline_errcode(errcode):
+    """ Maps a raw return-code onto an Errcode member the way ApiError used
+    to, by scanning the whole enum. """
+
+    matches = [x for x in Errcode if x == int(errcode)]
+    return matches[0] if matches else int(errcode)
+
+
+def baseline_confirm_success(result, func, args=None):
+    """ confirm_success() as it was before the lookup tables. """
+
+    if int(result) == Errcode.OK:
+        return Errcode(int(result))
+
+    if int(result) in list(Errcode):
+        errcode = Errcode(int(result))
+
+        if errcode.value < 0:
+            raise CommunicationError(func.__name__, errcode)
+    else:
+        errcode = int(result)
+
+    arg_str = "(%s)" % ", ".join(repr(x)[:64] for x in args)
+    raise CallFailure(func.__name__ + arg_str, errcode)
+
+
+def per_call(function, count):
+    """ Returns the average time of a call to function(), in microseconds. """
+
+    return timeit.timeit(function, number=count) / count * 1e6
+
+
+def bench_errors(api, count, baseline=False):
+    """ Measures failing read_memory() calls, and ApiError construction. """
+
+    def fail(address):
+        try:
+            api.read_memory(address, 32, 4)
+        except (CallFailure, CommunicationError):
+            pass
+
+    yield "failed call: communication", per_call(
+        lambda: fail(FAIL_COMMUNICATION), count)
+    yield "failed call: call failure", per_call(
+        lambda: fail(FAIL_CALL), count)
+    if baseline:
+        yield "ApiError(int)", per_call(
+            lambda: ApiError("x", baseline_errcode(2)), count)
+    else:
+        yield "ApiError(int)", per_call(lambda: ApiError("x", 2), count)
+
+
+def bench_memory(api, count, size):
+    """ Measures read_memory(), read_memory_into(), and write_memory() with
+    'size'-byte blocks. """
+
+    data = bytes(size)
+    buffer = bytearray(size)
+
+    yield f"read_memory {size}B", per_call(
+        lambda: api.read_memory(0, 32, size), count)
+    yield f"read_memory_into {size}B", per_call(
+        lambda: api.read_memory_into(0, 32, buffer), count)
+    yield f"write_memory {size}B", per_call(
+        lambda: api.write_memory(0, 32, data), count)
+
+
+def main():
+    """ Runs every benchmark with the baseline error mapping, through ctypes,
+    and (if available) through the native extension, and prints a table of
+    the results. """
+
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("libfile", help="""Path to the stand-in library
+                        built from stub_t32api.c.""")
+    parser.add_argument("-n", "--count", type=int, default=100000,
+                        help="""Calls per measurement (default:
+                        %(default)s).""")
+    parser.add_argument("--sizes", default="4,64,4096", help="""Block sizes
+                        for the memory benchmarks (default: %(default)s).""")
+    args = parser.parse_args()
+
+    api = Trace32API(args.libfile)
+    native = api.native
+    modes = ["baseline", "ctypes"]
+
+    if native is not None:
+        modes.append("native")
+
+    functions = [api.dll.read_memory, api.dll.write_memory]
+    errcheck = functions[0].errcheck
+    results = {}
+
+    for mode in modes:
+        api.native = native if mode == "native" else None
+
+        for function in functions:
+            if mode == "baseline":
+                function.errcheck = baseline_confirm_success
+            else:
+                function.errcheck = errcheck
+
+        rows = list(bench_errors(api, args.count, mode == "baseline"))
+
+        for size in [int(x) for x in args.sizes.split(",")]:
+            rows += list(bench_memory(api, args.count, size))
+
+        for name, micros in rows:
+            results.setdefault(name, {})[mode] = micros
+
+    print(f"{'BENCHMARK':<32}" + "".join(f"{x:>12}" for x in modes))
+
+    for name, row in results.items():
+        print(f"{name:<32}" +
+              "".join(f"{row[x]:>10.2f}us" for x in modes))
+
+
+if __name__ == "__main__":
+    main()
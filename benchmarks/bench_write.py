@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+""" Benchmark for practice-mode writes (Data.LOAD.Binary), run against the
+loopback API. Each load takes size/bandwidth seconds, so the time on top of
+that is host overhead: receiving the input, writing block files, and issuing
+commands.
+
+The 'single buffer' row reproduces _write_practice() from before the file
+ring: every block from the pipe was copied through Python into one
+buffer.bin, and only received once the previous load had finished.
+
+The 'file' rows load a seekable file with fixed-size chunks (--load-time 0),
+and with chunks that grow toward --load-time. Use --latency to model the
+per-command cost of a real probe. """
+
+import argparse
+import os
+import sys
+import tempfile
+import threading
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), ".."))
+
+# pylint: disable=wrong-import-position
+from trace32_cli.t32iface import Trace32Interface
+from trace32_cli.trace32_cli import _write_practice
+
+# --------------------------------------------------------------------------- #
+
+ADDRESS = 0x10000000
+SCRATCHPAD = 0xF0000000
+
+
+def write_args(infile, blocksize, load_time=None, queue_depth=2):
+    """ Returns the parsed arguments that _write_practice() expects. """
+
+    return argparse.Namespace(
+        address=ADDRESS, infile=infile, blocksize=blocksize,
+        load_time=load_time, queue_depth=queue_depth, check="sparse",
+        scratchpad=SCRATCHPAD, verbosity=0, logdest=sys.stderr,
+        log=lambda msg, level=0: None)
+
+
+def single_buffer(args, iface):
+    """ _write_practice() for non-seekable input, as it was before the file
+    ring was added. """
+
+    buffer_file = os.path.join(iface.tempdir, "buffer.bin")
+    base_command = f"Data.LOAD.Binary {buffer_file} @start++@size /PVerify"
+    address = args.address
+
+    while True:
+        block = args.infile.read(args.blocksize)
+        with open(buffer_file, "wb") as outfile:
+            outfile.write(block)
+
+        if not block:
+            return
+
+        cmd = base_command.replace("@start", hex(address))
+        cmd = cmd.replace("@size", hex(len(block) - 1))
+        iface.run_command(cmd)
+        address += len(block)
+
+
+def pipe_input(size):
+    """ Returns a pipe that a background thread fills with 'size' bytes. """
+
+    readfd, writefd = os.pipe()
+
+    def produce():
+        block = bytes(2**16)
+        remaining = size
+
+        while remaining > 0:
+            remaining -= os.write(writefd, block[:remaining])
+
+        os.close(writefd)
+
+    threading.Thread(target=produce, daemon=True).start()
+    return os.fdopen(readfd, "rb")
+
+
+def bench_pipe(iface, size, blocksize):
+    """ Measures writes of 'size' bytes from a pipe, with and without the
+    file ring. """
+
+    for name, function in [("pipe: single buffer", single_buffer),
+                           ("pipe: file ring", _write_practice)]:
+        with pipe_input(size) as infile:
+            start = time.monotonic()
+            function(write_args(infile, blocksize), iface)
+            elapsed = time.monotonic() - start
+
+        yield name, elapsed, iface.api.calls["T32_ExecuteCommand"]
+        iface.api.calls.clear()
+
+
+def bench_file(iface, size, blocksize, load_time):
+    """ Measures writes of a 'size'-byte file, with fixed-size chunks and
+    with chunks that grow toward 'load_time'. """
+
+    with tempfile.NamedTemporaryFile(dir=iface.tempdir) as infile:
+        infile.truncate(size)
+
+        for name, seconds in [("file: fixed chunks", None),
+                              ("file: growing chunks", load_time)]:
+            start = time.monotonic()
+            _write_practice(write_args(infile, blocksize, seconds), iface)
+            elapsed = time.monotonic() - start
+
+            yield name, elapsed, iface.api.calls["T32_ExecuteCommand"]
+            iface.api.calls.clear()
+
+
+def main():
+    """ Runs every benchmark, and prints a table of the results. """
+
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("-s", "--size", type=int, default=64, help="""Size
+                        of the image, in MiB (default: %(default)s).""")
+    parser.add_argument("-b", "--blocksize", type=int, default=1024,
+                        help="""Blocksize, in KiB (default:
+                        %(default)s).""")
+    parser.add_argument("--bandwidth", type=float, default=100e6,
+                        help="""Simulated load bandwidth, in bytes/sec
+                        (default: %(default)s).""")
+    parser.add_argument("--latency", type=float, default=0.0,
+                        help="""Simulated per-call latency, in seconds
+                        (default: %(default)s).""")
+    parser.add_argument("-l", "--load-time", type=float, default=1.0,
+                        help="""Target duration of each load for the
+                        growing-chunk benchmark (default: %(default)s).""")
+    args = parser.parse_args()
+
+    size = args.size * 2**20
+    blocksize = args.blocksize * 2**10
+    libfile = f"loopback:latency={args.latency},bandwidth={args.bandwidth}"
+    load_time = size / args.bandwidth
+
+    print(f"{size} bytes, {blocksize}-byte blocks, "
+          f"{load_time:.2f}s of pure load time")
+    print(f"{'BENCHMARK':<28}{'TOTAL':>10}{'OVERHEAD':>10}{'LOADS':>8}")
+
+    with Trace32Interface(libfile=libfile, sequenced=True) as iface:
+        rows = list(bench_pipe(iface, size, blocksize))
+        rows += bench_file(iface, size, blocksize, args.load_time)
+
+        for name, elapsed, loads in rows:
+            print(f"{name:<28}{elapsed:>9.2f}s"
+                  f"{elapsed - load_time:>9.2f}s{loads:>8}")
+
+
+if __name__ == "__main__":
+    main()
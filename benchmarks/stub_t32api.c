@@ -0,0 +1,107 @@
+/*
+ * Stand-in for _t32api.so, for benchmarking the Python side of the API
+ * without TRACE32. Every wrapped function succeeds without doing anything,
+ * except for read_memory/write_memory, which work on a 1 MiB buffer.
+ * Accesses at FAIL_COMMUNICATION and FAIL_CALL return an error code instead,
+ * so that the cost of mapping failed calls onto exceptions can be measured.
+ *
+ * Build it with:
+ *
+ *   gcc -shared -fPIC -O2 stub_t32api.c -o stub_t32api.so
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MEMORY_SIZE (1 << 20)
+#define FAIL_COMMUNICATION 0xDEAD0000UL
+#define FAIL_CALL 0xBEEF0000UL
+
+#define T32_ERR_COM_TRANSMIT_FAIL (-2)
+#define T32_ERR_STD_RUNNING 2
+
+static uint8_t memory[MEMORY_SIZE];
+
+/* ------------------------------------------------------------------------- */
+
+static int check_access(size_t address, int length)
+{
+    if (address == FAIL_COMMUNICATION) {
+        return T32_ERR_COM_TRANSMIT_FAIL;
+    }
+
+    if (address == FAIL_CALL) {
+        return T32_ERR_STD_RUNNING;
+    }
+
+    if ((length < 0) || (address > MEMORY_SIZE) ||
+        ((size_t)length > MEMORY_SIZE - address)) {
+        return T32_ERR_STD_RUNNING;
+    }
+
+    return 0;
+}
+
+int read_memory(size_t address, uint8_t width, char *buffer, int length)
+{
+    int result = check_access(address, length);
+
+    (void)width;
+
+    if (result == 0) {
+        memcpy(buffer, memory + address, length);
+    }
+
+    return result;
+}
+
+int write_memory(size_t address, uint8_t width, char *buffer, int length)
+{
+    int result = check_access(address, length);
+
+    (void)width;
+
+    if (result == 0) {
+        memcpy(memory + address, buffer, length);
+    }
+
+    return result;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* The rest of the functions that Trace32API wraps. They're never called by
+ * the benchmark, but they have to exist for the library to load. */
+
+#define STUB(name) int name(void) { return 0; }
+
+STUB(T32_Config)
+STUB(T32_Init)
+STUB(T32_Exit)
+STUB(T32_Attach)
+STUB(T32_Nop)
+STUB(T32_Ping)
+STUB(T32_Cmd)
+STUB(T32_ExecuteCommand)
+STUB(T32_ExecuteFunction)
+STUB(T32_Stop)
+STUB(T32_EvalGet)
+STUB(T32_EvalGetString)
+STUB(T32_GetMessageString)
+STUB(T32_Terminate)
+STUB(T32_GetPracticeState)
+STUB(T32_ResetCPU)
+STUB(T32_Break)
+STUB(T32_RequestBufferObj)
+STUB(T32_ReleaseBufferObj)
+STUB(T32_CopyDataFromBufferObj)
+STUB(T32_CopyDataToBufferObj)
+STUB(T32_RequestAddressObjA32)
+STUB(T32_RequestAddressObjA64)
+STUB(T32_ReleaseAddressObj)
+STUB(T32_ReadMemoryObj)
+STUB(T32_WriteMemoryObj)
+STUB(T32_BundledAccessAlloc)
+STUB(T32_BundledAccessExecute)
+STUB(T32_BundledAccessFree)
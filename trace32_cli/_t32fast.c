@@ -0,0 +1,466 @@
+/*
+ * Optional native fast path for the memory functions exported by
+ * _t32api.so. Trace32API uses this module when it's been built, and falls
+ * back to ctypes otherwise. It avoids ctypes argument conversion, errcheck
+ * calls, and intermediate buffers on every read_memory/write_memory call,
+ * and releases the GIL while the call is in progress.
+ *
+ * Build it next to _t32api.so with:
+ *
+ *   gcc -shared -fPIC -O2 $(python3-config --includes) _t32fast.c \
+ *       -o _t32fast$(python3-config --extension-suffix) -ldl
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <dlfcn.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef int (*memory_func)(size_t address, uint8_t width, char *buffer,
+                           int length);
+
+typedef struct {
+    void *handle;
+    memory_func read_memory;
+    memory_func write_memory;
+    PyObject *error_classes;
+    PyObject *default_class;
+} library;
+
+#define CAPSULE_NAME "trace32_cli._t32fast.library"
+
+/* ------------------------------------------------------------------------- */
+
+static void library_free(PyObject *capsule)
+{
+    library *lib = PyCapsule_GetPointer(capsule, CAPSULE_NAME);
+
+    if (lib == NULL) {
+        return;
+    }
+
+    Py_XDECREF(lib->error_classes);
+    Py_XDECREF(lib->default_class);
+    dlclose(lib->handle);
+    free(lib);
+}
+
+static library *get_library(PyObject *capsule)
+{
+    return PyCapsule_GetPointer(capsule, CAPSULE_NAME);
+}
+
+/* Return codes are mapped onto exception classes with the same lookup table
+ * that's used by confirm_success() in t32api.py. Codes that aren't in the
+ * table are reported with the default class. */
+
+static PyObject *raise_error(library *lib, const char *funcname,
+                             unsigned long long address, int width, int length,
+                             int result)
+{
+    PyObject *key;
+    PyObject *cls;
+    PyObject *name;
+    PyObject *error;
+
+    key = PyLong_FromLong(result);
+    if (key == NULL) {
+        return NULL;
+    }
+
+    cls = PyDict_GetItemWithError(lib->error_classes, key);
+    Py_DECREF(key);
+
+    if (cls == NULL) {
+        if (PyErr_Occurred()) {
+            return NULL;
+        }
+        cls = lib->default_class;
+    }
+
+    name = PyUnicode_FromFormat("%s(%llu, %d, ..., %d)", funcname, address,
+                                width, length);
+    if (name == NULL) {
+        return NULL;
+    }
+
+    error = PyObject_CallFunction(cls, "Oi", name, result);
+    Py_DECREF(name);
+
+    if (error != NULL) {
+        PyErr_SetObject(cls, error);
+        Py_DECREF(error);
+    }
+
+    return NULL;
+}
+
+static int resolve_width(unsigned long long address, int width)
+{
+    if (width != 0) {
+        return width;
+    }
+
+    return (address >= 0x100000000ULL) ? 64 : 32;
+}
+
+/* The API takes an int length, so longer blocks are rejected instead of
+ * being silently truncated. */
+
+static int check_length(Py_ssize_t length)
+{
+    if ((length < 0) || (length > INT_MAX)) {
+        PyErr_Format(PyExc_ValueError,
+                     "length %zd is out of range (0 to %d)", length,
+                     INT_MAX);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int call_memory(memory_func func, unsigned long long address,
+                       int width, char *buffer, int length)
+{
+    int result;
+
+    Py_BEGIN_ALLOW_THREADS
+    result = func((size_t)address, (uint8_t)width, buffer, length);
+    Py_END_ALLOW_THREADS
+
+    return result;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static PyObject *t32fast_load(PyObject *Py_UNUSED(self), PyObject *args)
+{
+    const char *path;
+    PyObject *error_classes;
+    PyObject *default_class;
+    library *lib;
+    PyObject *capsule;
+
+    if (!PyArg_ParseTuple(args, "sO!O", &path, &PyDict_Type, &error_classes,
+                          &default_class)) {
+        return NULL;
+    }
+
+    lib = calloc(1, sizeof(*lib));
+    if (lib == NULL) {
+        return PyErr_NoMemory();
+    }
+
+    lib->handle = dlopen(path, RTLD_NOW);
+    if (lib->handle == NULL) {
+        free(lib);
+        return PyErr_Format(PyExc_OSError, "%s", dlerror());
+    }
+
+    lib->read_memory = (memory_func)dlsym(lib->handle, "read_memory");
+    lib->write_memory = (memory_func)dlsym(lib->handle, "write_memory");
+
+    if ((lib->read_memory == NULL) || (lib->write_memory == NULL)) {
+        dlclose(lib->handle);
+        free(lib);
+        return PyErr_Format(PyExc_OSError,
+                            "%s doesn't export read_memory/write_memory",
+                            path);
+    }
+
+    Py_INCREF(error_classes);
+    Py_INCREF(default_class);
+    lib->error_classes = error_classes;
+    lib->default_class = default_class;
+
+    capsule = PyCapsule_New(lib, CAPSULE_NAME, library_free);
+    if (capsule == NULL) {
+        Py_DECREF(error_classes);
+        Py_DECREF(default_class);
+        dlclose(lib->handle);
+        free(lib);
+    }
+
+    return capsule;
+}
+
+static PyObject *t32fast_read_memory(PyObject *Py_UNUSED(self), PyObject *args)
+{
+    PyObject *capsule;
+    unsigned long long address;
+    int width;
+    Py_ssize_t length;
+    library *lib;
+    PyObject *result;
+    int status;
+
+    if (!PyArg_ParseTuple(args, "OKin", &capsule, &address, &width, &length)) {
+        return NULL;
+    }
+
+    if ((lib = get_library(capsule)) == NULL) {
+        return NULL;
+    }
+
+    if (check_length(length) != 0) {
+        return NULL;
+    }
+
+    width = resolve_width(address, width);
+    result = PyBytes_FromStringAndSize(NULL, length);
+    if (result == NULL) {
+        return NULL;
+    }
+
+    status = call_memory(lib->read_memory, address, width,
+                         PyBytes_AS_STRING(result), (int)length);
+
+    if (status != 0) {
+        Py_DECREF(result);
+        return raise_error(lib, "read_memory", address, width, (int)length,
+                           status);
+    }
+
+    return result;
+}
+
+static PyObject *t32fast_read_memory_into(PyObject *Py_UNUSED(self),
+                                          PyObject *args)
+{
+    PyObject *capsule;
+    unsigned long long address;
+    int width;
+    Py_buffer view;
+    library *lib;
+    int length;
+    int status;
+
+    if (!PyArg_ParseTuple(args, "OKiw*", &capsule, &address, &width, &view)) {
+        return NULL;
+    }
+
+    if (((lib = get_library(capsule)) == NULL) ||
+        (check_length(view.len) != 0)) {
+        PyBuffer_Release(&view);
+        return NULL;
+    }
+
+    length = (int)view.len;
+    width = resolve_width(address, width);
+    status = call_memory(lib->read_memory, address, width, view.buf, length);
+    PyBuffer_Release(&view);
+
+    if (status != 0) {
+        return raise_error(lib, "read_memory", address, width, length,
+                           status);
+    }
+
+    return PyLong_FromLong(length);
+}
+
+static PyObject *t32fast_write_memory(PyObject *Py_UNUSED(self),
+                                      PyObject *args)
+{
+    PyObject *capsule;
+    unsigned long long address;
+    int width;
+    Py_buffer view;
+    library *lib;
+    int length;
+    int status;
+
+    if (!PyArg_ParseTuple(args, "OKiy*", &capsule, &address, &width, &view)) {
+        return NULL;
+    }
+
+    if (((lib = get_library(capsule)) == NULL) ||
+        (check_length(view.len) != 0)) {
+        PyBuffer_Release(&view);
+        return NULL;
+    }
+
+    length = (int)view.len;
+    width = resolve_width(address, width);
+    status = call_memory(lib->write_memory, address, width, view.buf, length);
+    PyBuffer_Release(&view);
+
+    if (status != 0) {
+        return raise_error(lib, "write_memory", address, width, length,
+                           status);
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *t32fast_read_memory_many(PyObject *Py_UNUSED(self),
+                                          PyObject *args)
+{
+    PyObject *capsule;
+    PyObject *requests;
+    PyObject *sequence;
+    PyObject *results;
+    library *lib;
+    Py_ssize_t count;
+    Py_ssize_t index;
+
+    if (!PyArg_ParseTuple(args, "OO", &capsule, &requests)) {
+        return NULL;
+    }
+
+    if ((lib = get_library(capsule)) == NULL) {
+        return NULL;
+    }
+
+    sequence = PySequence_Fast(requests, "requests must be a sequence");
+    if (sequence == NULL) {
+        return NULL;
+    }
+
+    count = PySequence_Fast_GET_SIZE(sequence);
+    results = PyList_New(count);
+
+    for (index = 0; (results != NULL) && (index < count); index++) {
+        PyObject *item = PySequence_Fast_GET_ITEM(sequence, index);
+        unsigned long long address;
+        Py_ssize_t length;
+        PyObject *block;
+        int width;
+        int status;
+
+        if (!PyArg_ParseTuple(item, "Kn", &address, &length) ||
+            (check_length(length) != 0)) {
+            Py_CLEAR(results);
+            break;
+        }
+
+        width = resolve_width(address, 0);
+        block = PyBytes_FromStringAndSize(NULL, length);
+        if (block == NULL) {
+            Py_CLEAR(results);
+            break;
+        }
+
+        status = call_memory(lib->read_memory, address, width,
+                             PyBytes_AS_STRING(block), (int)length);
+
+        if (status != 0) {
+            Py_DECREF(block);
+            Py_CLEAR(results);
+            raise_error(lib, "read_memory", address, width, (int)length,
+                        status);
+            break;
+        }
+
+        PyList_SET_ITEM(results, index, block);
+    }
+
+    Py_DECREF(sequence);
+    return results;
+}
+
+static PyObject *t32fast_write_memory_many(PyObject *Py_UNUSED(self),
+                                           PyObject *args)
+{
+    PyObject *capsule;
+    PyObject *blocks;
+    PyObject *sequence;
+    library *lib;
+    Py_ssize_t count;
+    Py_ssize_t index;
+
+    if (!PyArg_ParseTuple(args, "OO", &capsule, &blocks)) {
+        return NULL;
+    }
+
+    if ((lib = get_library(capsule)) == NULL) {
+        return NULL;
+    }
+
+    sequence = PySequence_Fast(blocks, "blocks must be a sequence");
+    if (sequence == NULL) {
+        return NULL;
+    }
+
+    count = PySequence_Fast_GET_SIZE(sequence);
+
+    for (index = 0; index < count; index++) {
+        PyObject *item = PySequence_Fast_GET_ITEM(sequence, index);
+        unsigned long long address;
+        Py_buffer view;
+        int length;
+        int width;
+        int status;
+
+        if (!PyArg_ParseTuple(item, "Ky*", &address, &view)) {
+            Py_DECREF(sequence);
+            return NULL;
+        }
+
+        if (check_length(view.len) != 0) {
+            PyBuffer_Release(&view);
+            Py_DECREF(sequence);
+            return NULL;
+        }
+
+        length = (int)view.len;
+        width = resolve_width(address, 0);
+        status = call_memory(lib->write_memory, address, width, view.buf,
+                             length);
+        PyBuffer_Release(&view);
+
+        if (status != 0) {
+            Py_DECREF(sequence);
+            return raise_error(lib, "write_memory", address, width, length,
+                               status);
+        }
+    }
+
+    Py_DECREF(sequence);
+    Py_RETURN_NONE;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static PyMethodDef t32fast_methods[] = {
+    {"load", t32fast_load, METH_VARARGS,
+     "load(libfile, error_classes, default_class) -> library\n\n"
+     "Opens libfile and looks up its read_memory/write_memory functions.\n"
+     "Failed calls raise error_classes[code], or default_class for codes\n"
+     "that aren't in error_classes."},
+    {"read_memory", t32fast_read_memory, METH_VARARGS,
+     "read_memory(library, address, width, length) -> bytes\n\n"
+     "Reads a block of target memory. A width of 0 is auto-determined."},
+    {"read_memory_into", t32fast_read_memory_into, METH_VARARGS,
+     "read_memory_into(library, address, width, buffer) -> int\n\n"
+     "Reads len(buffer) bytes of target memory into a writable buffer."},
+    {"write_memory", t32fast_write_memory, METH_VARARGS,
+     "write_memory(library, address, width, data) -> None\n\n"
+     "Writes a block of data to target memory."},
+    {"read_memory_many", t32fast_read_memory_many, METH_VARARGS,
+     "read_memory_many(library, [(address, length), ...]) -> list\n\n"
+     "Reads a list of blocks, with auto-determined address widths."},
+    {"write_memory_many", t32fast_write_memory_many, METH_VARARGS,
+     "write_memory_many(library, [(address, data), ...]) -> None\n\n"
+     "Writes a list of blocks, with auto-determined address widths."},
+    {NULL, NULL, 0, NULL}
+};
+
+static struct PyModuleDef t32fast_module = {
+    PyModuleDef_HEAD_INIT,
+    "_t32fast",
+    "Native fast path for the memory functions in _t32api.so.",
+    -1,
+    t32fast_methods,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+};
+
+PyMODINIT_FUNC PyInit__t32fast(void)
+{
+    return PyModule_Create(&t32fast_module);
+}
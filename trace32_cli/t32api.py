@@ -5,13 +5,20 @@ better-quality replacement for Lauterbach's `python-legacy` module, and also
 their `python-rcl` module (which is missing a lot of functionality at the
 time of this writing). """
 
+import contextlib
 import ctypes
 import enum
 import os
 import re
+import threading
 
 from .t32api_errors import Errcode
 
+try:
+    from . import _t32fast
+except ImportError:
+    _t32fast = None
+
 # Errcode is auto-generated by parsing t32.h from the Trace32 CAPI. This assert
 # is intended to verify that t32api_errors.py was created correctly.
 assert len(Errcode) > 1
@@ -29,12 +36,10 @@ class ApiError(Exception):
         if isinstance(errcode, Errcode):
             self.errcode = errcode
         else:
-            matches = [x for x in Errcode if x == int(errcode)]
+            self.errcode = _ERRCODES.get(int(errcode), int(errcode))
 
-            if matches:
-                self.errcode = matches[0]
-            else:
-                self.errcode = int(errcode)
+    def __reduce__(self):
+        return (self.__class__, (self.funcname, self.errcode))
 
     def __str__(self):
         err_msg = f"Function '{self.funcname}' returned nonzero status of "
@@ -67,6 +72,9 @@ class CommandFailure(Exception):
         self.command = command
         self.error = error
 
+    def __reduce__(self):
+        return (self.__class__, (self.command, self.error))
+
     def __str__(self):
         return self.error
 
@@ -80,6 +88,9 @@ class EvalError(Exception):
         self.reason = reason
         self.name = re.search("'.*'", str(self.__class__)).group(0)[1:-1]
 
+    def __reduce__(self):
+        return (self.__class__, (self.reason, self.expression))
+
     @staticmethod
     def _shorten(phrase):
         if phrase is None:
@@ -181,25 +192,38 @@ class StringConverter:
         return ctypes.c_char_p(data)
 
 
+# Lookup tables used for mapping raw return-codes onto Errcode members, and
+# onto the exception class that reports them. These are built once at
+# import-time, since some callers poll in tight loops on calls that are
+# expected to fail.
+#
+# Note on the classification: From api_remote_c.pdf, Lauterbach states that
+# negative values are reserved for communication/library errors, and positive
+# values are reserved for failed commands and the like. Codes that aren't in
+# Errcode are always reported as CallFailure.
+
+_ERRCODES = {int(x): x for x in Errcode}
+
+_ERROR_CLASSES = {
+    code: (CommunicationError if code < 0 else CallFailure)
+    for code in _ERRCODES if code != Errcode.OK
+}
+
+
 def confirm_success(result, func, args=None):
     """ Confirms that the value of result is 0, and then returns it. Raises
     an error otherwise. Intended to commonize error-detection across all
     wrapped functions. """
 
-    if int(result) == Errcode.OK:
-        return Errcode(int(result))
+    result = int(result)
 
-    # Note on this: From api_remote_c.pdf, Lauterbach states that negative
-    # values are reserved for communication/library errors, and positive
-    # values are reserved for failed commands and the like.
+    if result == Errcode.OK:
+        return Errcode.OK
 
-    if int(result) in list(Errcode):
-        errcode = Errcode(int(result))
+    errcode = _ERRCODES.get(result, result)
 
-        if errcode.value < 0:
-            raise CommunicationError(func.__name__, errcode)
-    else:
-        errcode = int(result)
+    if _ERROR_CLASSES.get(result) is CommunicationError:
+        raise CommunicationError(func.__name__, errcode)
 
     arg_strings = []
 
@@ -214,6 +238,15 @@ def confirm_success(result, func, args=None):
     raise CallFailure(func.__name__ + arg_str, errcode)
 
 
+def _address_width(address, address_width=None):
+    """ Returns address_width, or auto-determines it from the address if it's
+    None. """
+
+    if address_width is not None:
+        return address_width
+
+    return 64 if address >= 2**32 else 32
+
 # --------------------------------------------------------------------------- #
 
 
@@ -268,9 +301,167 @@ def _dll_init_generic(dll):
     return dll
 
 
+def _dll_init_memory(dll):
+    """ Configure the ctypes wrappers of the object-based "Memory Access"
+    functions imported from the Trace32 CAPI, including bundled access. Buffer,
+    address, and bundle handles are all opaque pointers. """
+
+    function_list = [
+        'T32_RequestBufferObj', 'T32_ReleaseBufferObj',
+        'T32_CopyDataFromBufferObj', 'T32_CopyDataToBufferObj',
+        'T32_RequestAddressObjA32', 'T32_RequestAddressObjA64',
+        'T32_ReleaseAddressObj', 'T32_ReadMemoryObj', 'T32_WriteMemoryObj',
+        'T32_BundledAccessAlloc', 'T32_BundledAccessExecute',
+        'T32_BundledAccessFree'
+    ]
+
+    for name in function_list:
+        function = dll.__getattr__(name)
+        function.argtypes = ()
+        function.restype = ctypes.c_int
+        function.errcheck = confirm_success
+
+    handle_ptr = ctypes.POINTER(ctypes.c_void_p)
+
+    dll.T32_RequestBufferObj.argtypes = (handle_ptr, ctypes.c_int)
+    dll.T32_ReleaseBufferObj.argtypes = (handle_ptr,)
+
+    dll.T32_CopyDataFromBufferObj.argtypes = (
+        ctypes.POINTER(ctypes.c_char),
+        ctypes.c_int,
+        ctypes.c_int,
+        ctypes.c_void_p
+    )
+
+    dll.T32_CopyDataToBufferObj.argtypes = (
+        ctypes.c_void_p,
+        ctypes.c_int,
+        ctypes.c_int,
+        ctypes.POINTER(ctypes.c_char)
+    )
+
+    dll.T32_RequestAddressObjA32.argtypes = (handle_ptr, ctypes.c_uint32)
+    dll.T32_RequestAddressObjA64.argtypes = (handle_ptr, ctypes.c_uint64)
+    dll.T32_ReleaseAddressObj.argtypes = (handle_ptr,)
+
+    for name in ['T32_ReadMemoryObj', 'T32_WriteMemoryObj']:
+        dll.__getattr__(name).argtypes = (
+            ctypes.c_void_p,
+            ctypes.c_void_p,
+            ctypes.c_int
+        )
+
+    dll.T32_BundledAccessAlloc.argtypes = (handle_ptr,)
+    dll.T32_BundledAccessExecute.argtypes = (ctypes.c_void_p,)
+    dll.T32_BundledAccessFree.argtypes = (ctypes.c_void_p,)
+
+    return dll
+
+
+def _dll_init_channel(dll):
+    """ Configure the ctypes wrappers of the CAPI's channel functions, which
+    are used for talking to more than one TRACE32 instance from a single
+    process. Returns False if the library doesn't export them. """
+
+    try:
+        dll.T32_GetChannelSize.argtypes = ()
+    except AttributeError:
+        return False
+
+    dll.T32_GetChannelSize.restype = ctypes.c_int
+    dll.T32_GetChannelDefaults.argtypes = (ctypes.c_void_p,)
+    dll.T32_GetChannelDefaults.restype = None
+    dll.T32_SetChannel.argtypes = (ctypes.c_void_p,)
+    dll.T32_SetChannel.restype = None
+    return True
+
+# --------------------------------------------------------------------------- #
+
+# The CAPI's active channel is global to each loaded library, and is shared by
+# every Trace32API that uses it. Calls are serialized with one lock per library
+# file, so that a channel can't be switched out from under a call in progress.
+
+class _LibraryState:
+    """ Tracks the lock and the currently-active channel of a library. """
+    # pylint: disable=too-few-public-methods
+
+    def __init__(self):
+        self.lock = threading.RLock()
+        self.active = None
+
+
+_LIBRARY_STATES = {}
+_LIBRARY_STATES_GUARD = threading.Lock()
+
+
+def _library_state(libfile):
+    """ Returns the shared _LibraryState for 'libfile'. """
+
+    with _LIBRARY_STATES_GUARD:
+        return _LIBRARY_STATES.setdefault(libfile, _LibraryState())
+
+
+class _Channel:
+    """ A CAPI channel object, which holds the connection state of one
+    TRACE32 instance. Entering it as a context-manager locks the library and
+    makes this channel the active one until the context is exited. The channel
+    is only switched if it isn't already active. """
+
+    def __init__(self, dll, state):
+        self.buffer = ctypes.create_string_buffer(dll.T32_GetChannelSize())
+        dll.T32_GetChannelDefaults(self.buffer)
+        self._set_channel = dll.T32_SetChannel
+        self._state = state
+
+    def __enter__(self):
+        state = self._state
+        state.lock.acquire()
+
+        if state.active is not self:
+            try:
+                self._set_channel(self.buffer)
+            except BaseException:
+                state.lock.release()
+                raise
+
+            state.active = self
+
+        return self
+
+    def __exit__(self, exception_type, exception_val, trace):
+        self._state.lock.release()
+
+
+class _ChannelLibrary:
+    """ Stand-in for a configured ctypes library, where every function call
+    is made on a specific channel. Wrapped functions are cached on first use.
+    """
+
+    def __init__(self, dll, channel):
+        self._dll = dll
+        self._channel = channel
+
+    def __getattr__(self, name):
+        function = getattr(self._dll, name)
+        channel = self._channel
+
+        def call(*args):
+            with channel:
+                return function(*args)
+
+        call.__name__ = name
+        setattr(self, name, call)
+        return call
+
+
 class Trace32API:
     """ Ctypes-based wrapper around useful Trace32 CAPI functions. Adds some
-    argument management, standardized error-checking, etc. """
+    argument management, standardized error-checking, etc.
+
+    If the library supports channels, each instance owns its own channel, and
+    switches to it around every call. This lets any number of instances (each
+    connected to a different TRACE32) coexist in one process. Otherwise, all
+    instances share the library's single implicit connection. """
     # pylint: disable=invalid-name
 
     def __init__(self, libfile=None):
@@ -281,6 +472,7 @@ class Trace32API:
         libfile = os.path.abspath(libfile)
         self.dll = ctypes.cdll.LoadLibrary(libfile)
         self.dll = _dll_init_generic(self.dll)
+        self.dll = _dll_init_memory(self.dll)
 
         self.dll.read_memory.restype = ctypes.c_int
         self.dll.read_memory.errcheck = confirm_success
@@ -301,6 +493,131 @@ class Trace32API:
             ctypes.c_int
         )
 
+        # Each instance gets its own channel if the library supports them. The
+        # dll attribute is wrapped so that every call is made on that channel.
+
+        self.channel = None
+        self._select = contextlib.nullcontext()
+
+        if _dll_init_channel(self.dll):
+            self.channel = _Channel(self.dll, _library_state(libfile))
+            self._select = self.channel
+            self.dll = _ChannelLibrary(self.dll, self.channel)
+
+        # Response buffer shared by the functions that return a message. It's
+        # allocated once instead of on every call, and guarded by a lock in
+        # case an instance is used from more than one thread.
+
+        self._response = ctypes.create_string_buffer(2**16)
+        self._response_lock = threading.RLock()
+
+        # Callbacks that are run before anything that might change the
+        # target's state (a command, or a CPU break/reset). Used to keep
+        # memory caches coherent.
+
+        self.change_hooks = []
+
+        # The optional native extension is used for the memory functions if
+        # it's been built. Otherwise, they go through ctypes.
+
+        self.native = None
+
+        if _t32fast is not None:
+            try:
+                self.native = _t32fast.load(libfile, _ERROR_CLASSES,
+                                            CallFailure)
+            except OSError:
+                self.native = None
+
+    def read_memory(self, address, address_width, length):
+        """ Reads 'length' bytes from the target's memory-space and returns
+        them. An address_width of None is auto-determined. """
+
+        if self.native is not None:
+            with self._select:
+                return _t32fast.read_memory(self.native, address,
+                                            address_width or 0, length)
+
+        buffer = ctypes.create_string_buffer(length)
+        address_width = _address_width(address, address_width)
+        self.dll.read_memory(address, address_width, buffer, length)
+        return buffer.raw
+
+    def read_memory_into(self, address, address_width, buffer):
+        """ Reads from the target's memory-space directly into 'buffer', which
+        can be any writable object that supports the buffer protocol. Returns
+        the number of bytes read. """
+
+        if self.native is not None:
+            with self._select:
+                return _t32fast.read_memory_into(self.native, address,
+                                                 address_width or 0, buffer)
+
+        view = memoryview(buffer).cast('B')
+        length = view.nbytes
+        target = (ctypes.c_char * length).from_buffer(view)
+        address_width = _address_width(address, address_width)
+
+        try:
+            self.dll.read_memory(address, address_width, target, length)
+        finally:
+            del target
+            view.release()
+
+        return length
+
+    def write_memory(self, address, address_width, data):
+        """ Writes a block of data to the target's memory-space. """
+
+        if self.native is not None:
+            with self._select:
+                _t32fast.write_memory(self.native, address,
+                                      address_width or 0, data)
+            return
+
+        data = bytes(data)
+        address_width = _address_width(address, address_width)
+        self.dll.write_memory(address, address_width, data, len(data))
+
+    def read_memory_many(self, requests):
+        """ Reads a list of (address, length) blocks from the target's
+        memory-space with one read_memory call each, and returns a list of the
+        data. Address widths are auto-determined. """
+
+        if self.native is not None:
+            with self._select:
+                return _t32fast.read_memory_many(self.native, list(requests))
+
+        return [self.read_memory(address, None, length)
+                for address, length in requests]
+
+    def write_memory_many(self, blocks):
+        """ Writes a list of (address, data) blocks to the target's
+        memory-space with one write_memory call each. Address widths are
+        auto-determined. """
+
+        if self.native is not None:
+            with self._select:
+                _t32fast.write_memory_many(self.native, list(blocks))
+            return
+
+        for address, data in blocks:
+            self.write_memory(address, None, data)
+
+    def _clear_response(self):
+        """ Returns the shared response buffer, after terminating it at its
+        first byte so that a call which doesn't write a message can't return a
+        stale one. The caller must hold self._response_lock. """
+
+        self._response[0] = b'\x00'
+        return self._response
+
+    def _target_changed(self):
+        """ Runs every callback in self.change_hooks. """
+
+        for hook in self.change_hooks:
+            hook()
+
     def T32_Config(self, key, value):
         """ Sets $key to $value in the trace32 DLL. Used for setting up
         communication parameters before calling T32_Start(). Known parameters
@@ -343,6 +660,7 @@ class Trace32API:
         return immediately, and all other kinds of commands will block until
         they're completed. """
 
+        self._target_changed()
         self.dll.T32_Cmd(command)
 
     def T32_Nop(self):
@@ -365,21 +683,23 @@ class Trace32API:
 
         msg_type = ctypes.c_uint16(0)
         msg_len = ctypes.c_uint16(0)
-        buffer = ctypes.create_string_buffer(2**16)
-        self.dll.T32_GetMessageString(buffer, 2**16 - 1, msg_type, msg_len)
 
-        msg_type = msg_type.value
-        msg_len = msg_len.value
+        with self._response_lock:
+            buffer = self._clear_response()
+            self.dll.T32_GetMessageString(buffer, len(buffer) - 1, msg_type,
+                                          msg_len)
 
-        if msg_type == 0:
-            return {"msg": "", "types": (MessageType(0),)}
+            msg_type = msg_type.value
+            msg_len = min(msg_len.value, len(buffer))
 
-        if buffer[msg_len - 1:msg_len] == b'\x00':
-            msg_len -= 1
+            if msg_type == 0:
+                return {"msg": "", "types": (MessageType(0),)}
+
+            msg = ctypes.string_at(buffer, msg_len)
 
         # pylint: disable=consider-using-generator
         types = tuple([x for x in MessageType if int(x.value) & msg_type])
-        msg = buffer.value.decode("ascii")
+        msg = msg.split(b'\x00', 1)[0].decode("ascii")
         return {"msg": msg, "types": types}
 
     def T32_EvalGet(self):
@@ -395,9 +715,10 @@ class Trace32API:
         specific PRACTICE commands such as EVAL. There is potentially some
         overlap with messages reported on T32_GetMessageString. """
 
-        buffer = ctypes.create_string_buffer(2**16)
-        self.dll.T32_EvalGetString(buffer)
-        return buffer.value.decode("ascii")
+        with self._response_lock:
+            buffer = self._clear_response()
+            self.dll.T32_EvalGetString(buffer)
+            return buffer.value.decode("ascii")
 
     def T32_GetPracticeState(self):
         """ Checks to see whether a PRACTICE script is currently running. """
@@ -421,36 +742,47 @@ class Trace32API:
         response message (if any). DO commands will return immediately, and all
         other kinds of commands will block until they're completed. """
 
-        buffer = ctypes.create_string_buffer(2**16)
         call_failure = None
+        self._target_changed()
 
-        try:
-            self.dll.T32_ExecuteCommand(cmd, buffer, 2**16 - 1)
-        except CallFailure as err:
-            call_failure = err
+        with self._response_lock:
+            buffer = self._clear_response()
+
+            try:
+                self.dll.T32_ExecuteCommand(cmd, buffer, len(buffer) - 1)
+            except CallFailure as err:
+                call_failure = err
+
+            response = buffer.value.decode("ascii")
 
         if call_failure:
             if call_failure.errcode != Errcode.T32_ERR_EXECUTECOMMAND_FAIL:
                 raise call_failure
 
-            raise CommandFailure(cmd, buffer.value.decode("ascii"))
+            raise CommandFailure(cmd, response)
 
-        return buffer.value.decode("ascii")
+        return response
 
     def T32_ExecuteFunction(self, expression):
         """ Evaluate a TRACE32 expression/command. Return the resulting
         buffer, as well as its reported result-type. """
 
-        buff = ctypes.create_string_buffer(2**16)
         restype = ctypes.c_uint32(0)
         error = False
-        try:
-            self.dll.T32_ExecuteFunction(expression, buff, 2**16 - 1, restype)
-        except CallFailure:
-            error = True
+
+        with self._response_lock:
+            buff = self._clear_response()
+
+            try:
+                self.dll.T32_ExecuteFunction(expression, buff, len(buff) - 1,
+                                             restype)
+            except CallFailure:
+                error = True
+
+            buff = buff.value
 
         if error:
-            result = buff.value.decode('latin-1')
+            result = buff.decode('latin-1')
             raise EvalError(result, expression)
 
         if restype.value not in (x.value for x in ResultType):
@@ -458,7 +790,7 @@ class Trace32API:
             err_msg += " is unknown."
             raise ValueError(err_msg)
 
-        buff = buff.value.decode("ascii")
+        buff = buff.decode("ascii")
         return {"msg": buff, "type": ResultType(restype.value)}
 
     def T32_Stop(self):
@@ -470,9 +802,93 @@ class Trace32API:
         """ Reset the connected CPU. Effectively equivalent to running
         SYStem.UP and Register.RESet. """
 
+        self._target_changed()
         self.dll.T32_ResetCPU()
 
     def T32_Break(self):
         """ Break/halt the connected CPU.  """
 
+        self._target_changed()
         self.dll.T32_Break()
+
+    def T32_RequestBufferObj(self, size=0):
+        """ Allocates a buffer object for use with the object-based memory
+        functions, and returns its handle. A size of 0 makes a buffer that
+        grows as needed. """
+
+        handle = ctypes.c_void_p(None)
+        self.dll.T32_RequestBufferObj(ctypes.byref(handle), size)
+        return handle
+
+    def T32_ReleaseBufferObj(self, handle):
+        """ Frees a buffer object allocated by T32_RequestBufferObj. """
+
+        self.dll.T32_ReleaseBufferObj(ctypes.byref(handle))
+
+    def T32_CopyDataFromBufferObj(self, handle, size, offset=0):
+        """ Copies 'size' bytes out of a buffer object, starting at 'offset'.
+        Returns the data. """
+
+        buffer = ctypes.create_string_buffer(size)
+        self.dll.T32_CopyDataFromBufferObj(buffer, size, offset, handle)
+        return buffer.raw
+
+    def T32_CopyDataToBufferObj(self, handle, data, offset=0):
+        """ Copies 'data' into a buffer object, starting at 'offset'. """
+
+        data = bytes(data)
+        self.dll.T32_CopyDataToBufferObj(handle, len(data), offset, data)
+
+    def T32_RequestAddressObjA32(self, address):
+        """ Allocates an address object for a 32-bit address, and returns its
+        handle. """
+
+        handle = ctypes.c_void_p(None)
+        self.dll.T32_RequestAddressObjA32(ctypes.byref(handle), address)
+        return handle
+
+    def T32_RequestAddressObjA64(self, address):
+        """ Allocates an address object for a 64-bit address, and returns its
+        handle. """
+
+        handle = ctypes.c_void_p(None)
+        self.dll.T32_RequestAddressObjA64(ctypes.byref(handle), address)
+        return handle
+
+    def T32_ReleaseAddressObj(self, handle):
+        """ Frees an address object allocated by T32_RequestAddressObjA32 or
+        T32_RequestAddressObjA64. """
+
+        self.dll.T32_ReleaseAddressObj(ctypes.byref(handle))
+
+    def T32_ReadMemoryObj(self, buffer_handle, address_handle, length):
+        """ Reads 'length' bytes of target memory at an address object into a
+        buffer object. Only queued if a bundled access is active. """
+
+        self.dll.T32_ReadMemoryObj(buffer_handle, address_handle, length)
+
+    def T32_WriteMemoryObj(self, buffer_handle, address_handle, length):
+        """ Writes 'length' bytes from a buffer object into target memory at an
+        address object. Only queued if a bundled access is active. """
+
+        self.dll.T32_WriteMemoryObj(buffer_handle, address_handle, length)
+
+    def T32_BundledAccessAlloc(self):
+        """ Starts a bundled access. Object-based memory accesses are queued
+        up until T32_BundledAccessExecute, which sends all of them in a single
+        round trip. Returns the bundle's handle. """
+
+        handle = ctypes.c_void_p(None)
+        self.dll.T32_BundledAccessAlloc(ctypes.byref(handle))
+        return handle
+
+    def T32_BundledAccessExecute(self, handle):
+        """ Sends all of the accesses queued in a bundled access to Trace32,
+        and waits for them to complete. """
+
+        self.dll.T32_BundledAccessExecute(handle)
+
+    def T32_BundledAccessFree(self, handle):
+        """ Ends a bundled access, and frees its handle. """
+
+        self.dll.T32_BundledAccessFree(handle)
@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+""" Benchmarks for a connected Trace32Interface. Measures memory throughput
+over a range of block sizes, and the latency of the basic API operations, so
+that different probe/target setups (or a simulator) can be compared. """
+
+import os
+import statistics
+import time
+
+from .common import make_tempdir
+
+# --------------------------------------------------------------------------- #
+
+DEFAULT_SIZES = (4096, 16384, 65536, 262144, 2**20, 4 * 2**20)
+
+
+def measure(function, count):
+    """ Calls function() 'count' times, and returns a list of how long each
+    call took (in seconds). """
+
+    samples = []
+
+    for _ in range(count):
+        start = time.perf_counter()
+        function()
+        samples.append(time.perf_counter() - start)
+
+    return samples
+
+
+def summarize(samples):
+    """ Returns summary statistics for a list of latency samples, in
+    microseconds. """
+
+    ordered = sorted(samples)
+
+    def percentile(fraction):
+        return ordered[min(int(fraction * len(ordered)), len(ordered) - 1)]
+
+    return {
+        'count': len(ordered),
+        'min_us': ordered[0] * 1e6,
+        'median_us': statistics.median(ordered) * 1e6,
+        'mean_us': statistics.fmean(ordered) * 1e6,
+        'p90_us': percentile(0.90) * 1e6,
+        'p99_us': percentile(0.99) * 1e6,
+        'max_us': ordered[-1] * 1e6,
+    }
+
+
+def _throughput(function, blocksize, total, span):
+    """ Calls function(offset, blocksize) for enough blocks to move 'total'
+    bytes (at least three blocks), and returns the results as a dict. Offsets
+    wrap around so that every block stays within 'span' bytes. """
+
+    count = max(3, total // blocksize)
+    offset = 0
+    start = time.perf_counter()
+
+    for _ in range(count):
+        if offset + blocksize > span:
+            offset = 0
+
+        function(offset, blocksize)
+        offset += blocksize
+
+    elapsed = time.perf_counter() - start
+    nbytes = count * blocksize
+
+    return {
+        'blocksize': blocksize,
+        'blocks': count,
+        'bytes': nbytes,
+        'seconds': elapsed,
+        'rate': nbytes / max(elapsed, 1e-9),
+    }
+
+
+def run_benchmarks(iface, address, sizes=DEFAULT_SIZES, count=200,
+                   total=4 * 2**20, read_only=False, log=None):
+    """ Runs every benchmark on 'iface', and returns the results as a
+    JSON-serializable dict.
+
+    Latency is measured 'count' times for T32_Ping() and T32_Nop() (only on a
+    direct connection, since they're not available through a server),
+    run_command(), eval_expression(), and run_file() on an empty script.
+
+    Throughput is measured for read_memory() and write_memory() with each
+    block size in 'sizes', moving about 'total' bytes per size. Transfers
+    stay within max(total, max(sizes)) bytes starting at 'address', which must
+    be readable and writable (unless 'read_only' is set). The original
+    contents are restored after the write benchmark. """
+    # pylint: disable=too-many-arguments,too-many-locals
+
+    def note(message):
+        if log:
+            log(message, level=2)
+
+    span = max(total, max(sizes))
+    results = {'latency': {}, 'throughput': {'read': [], 'write': []}}
+    latency = results['latency']
+    api = getattr(iface, 'api', None)
+
+    if api is not None:
+        note("Measuring T32_Ping/T32_Nop latency.")
+        latency['ping'] = summarize(measure(api.T32_Ping, count))
+        latency['nop'] = summarize(measure(api.T32_Nop, count))
+
+    note("Measuring run_command/eval_expression latency.")
+    latency['run_command'] = summarize(
+        measure(lambda: iface.run_command("Eval 0"), count))
+    latency['eval_expression'] = summarize(
+        measure(lambda: iface.eval_expression("0x0"), count))
+
+    note("Measuring run_file overhead.")
+    with make_tempdir() as tempdir:
+        script = os.path.join(tempdir, "empty.cmm")
+
+        with open(script, "w", encoding="ascii") as outfile:
+            outfile.write("ENDDO\n")
+
+        latency['run_file'] = summarize(
+            measure(lambda: iface.run_file(script), max(count // 10, 5)))
+
+    for size in sizes:
+        note(f"Measuring read_memory throughput with {size}-byte blocks.")
+        results['throughput']['read'].append(_throughput(
+            lambda offset, length: iface.read_memory(address + offset,
+                                                     length),
+            size, total, span))
+
+    if read_only:
+        return results
+
+    original = iface.read_memory(address, span)
+    pattern = os.urandom(max(sizes))
+
+    try:
+        for size in sizes:
+            note(f"Measuring write_memory throughput with {size}-byte "
+                 f"blocks.")
+            results['throughput']['write'].append(_throughput(
+                lambda offset, length: iface.write_memory(address + offset,
+                                                          pattern[:length]),
+                size, total, span))
+    finally:
+        iface.write_memory(address, original)
+
+    return results
+
+
+def format_summary(results):
+    """ Formats the results from run_benchmarks() into a human-readable
+    summary, and returns its lines. """
+
+    lines = [f"{'OPERATION':<16}  {'MEDIAN':>10}  {'P90':>10}  {'P99':>10}  "
+             f"{'MAX':>10}"]
+
+    for name, stats in results['latency'].items():
+        lines.append(f"{name:<16}  {stats['median_us']:>8.1f}us  "
+                     f"{stats['p90_us']:>8.1f}us  {stats['p99_us']:>8.1f}us  "
+                     f"{stats['max_us']:>8.1f}us")
+
+    lines.append("")
+    lines.append(f"{'BLOCKSIZE':<16}  {'READ':>12}  {'WRITE':>12}")
+    writes = {x['blocksize']: x for x in results['throughput']['write']}
+
+    for entry in results['throughput']['read']:
+        size = entry['blocksize']
+        read_rate = f"{entry['rate'] / 1e6:.2f} MB/s"
+
+        if size in writes:
+            write_rate = f"{writes[size]['rate'] / 1e6:.2f} MB/s"
+        else:
+            write_rate = "-"
+
+        lines.append(f"{size:<16}  {read_rate:>12}  {write_rate:>12}")
+
+    return lines
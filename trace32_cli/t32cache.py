@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+""" Page-granular cache for target memory reads. Intended for callers that
+issue lots of small, overlapping reads while the target is halted (like a GDB
+client). Missing pages are fetched with as few reads as possible, by
+coalescing adjacent pages into a single request. """
+
+import collections
+
+# --------------------------------------------------------------------------- #
+
+
+class PageCache:
+    """ Caches target memory in aligned pages of 'page_size' bytes. Reads are
+    served from the cache where possible, and any missing pages are fetched
+    with read_func(address, length), one call per run of adjacent missing
+    pages. Up to 'max_pages' pages are kept, and the least-recently-used pages
+    are dropped first.
+
+    The cache has no way of knowing when the target's memory changes, so the
+    owner must call invalidate() whenever the target runs, is reset, or is
+    written to.
+
+    Page hits and misses are counted in 'hits' and 'misses', and the number
+    of reads that were issued to fill the misses is counted in 'fetches'. """
+
+    def __init__(self, read_func, page_size=4096, max_pages=4096):
+        if page_size & (page_size - 1):
+            raise ValueError("page_size must be a power of two")
+
+        self.read_func = read_func
+        self.page_size = page_size
+        self.max_pages = max_pages
+        self.pages = collections.OrderedDict()
+        self.hits = 0
+        self.misses = 0
+        self.fetches = 0
+
+    def _page_range(self, address, length):
+        """ Returns the base addresses of every page that overlaps the range
+        that starts at 'address' and is 'length' bytes long. """
+
+        first = address & ~(self.page_size - 1)
+        last = (address + max(length, 1) - 1) & ~(self.page_size - 1)
+        return range(first, last + 1, self.page_size)
+
+    def _fetch(self, bases):
+        """ Fetches a list of pages (given by base address, in ascending order)
+        into the cache. Adjacent pages are fetched with a single read. """
+
+        runs = []
+
+        for base in bases:
+            if runs and runs[-1][-1] + self.page_size == base:
+                runs[-1].append(base)
+            else:
+                runs.append([base])
+
+        for run in runs:
+            data = self.read_func(run[0], len(run) * self.page_size)
+            self.fetches += 1
+
+            for index, base in enumerate(run):
+                offset = index * self.page_size
+                self.pages[base] = bytes(data[offset:offset + self.page_size])
+
+    def read(self, address, length):
+        """ Returns 'length' bytes of target memory, starting at 'address'. """
+
+        if length <= 0:
+            return b''
+
+        bases = self._page_range(address, length)
+        missing = [x for x in bases if x not in self.pages]
+        self.misses += len(missing)
+        self.hits += len(bases) - len(missing)
+
+        if missing:
+            self._fetch(missing)
+
+        chunks = []
+
+        for base in bases:
+            self.pages.move_to_end(base)
+            chunks.append(self.pages[base])
+
+        while len(self.pages) > self.max_pages:
+            self.pages.popitem(last=False)
+
+        offset = address - bases[0]
+        return b''.join(chunks)[offset:offset + length]
+
+    def invalidate(self, address=None, length=None):
+        """ Drops the pages that overlap a range of memory from the cache. If
+        no range is given, the whole cache is dropped. """
+
+        if address is None:
+            self.pages.clear()
+            return
+
+        for base in self._page_range(address, length or 1):
+            self.pages.pop(base, None)
@@ -0,0 +1,253 @@
+#!/usr/bin/env python3
+""" Runs the same job on several TRACE32 targets at once. Each target gets its
+own worker process (and its own Trace32Subprocess), so that the targets are
+programmed/controlled in parallel. Log output from the workers is streamed back
+to the parent with a per-target prefix. """
+
+import collections
+import multiprocessing as mp
+import os
+import queue
+import signal
+import time
+
+try:
+    import tomllib
+except ImportError:
+    tomllib = None
+
+# --------------------------------------------------------------------------- #
+
+Target = collections.namedtuple("Target", ["name", "serial", "protocol",
+                                           "t32bin"])
+
+Result = collections.namedtuple("Result", ["name", "error", "runtime"])
+
+
+def load_targets(filename, protocol="usb", t32bin="t32marm"):
+    """ Loads a list of Targets from a TOML file. Each target is described by
+    a [[target]] table, which can contain the following keys:
+
+        name     - Label used for log output and for the result table.
+        serial   - Serial number (or nodename) of the debug probe to use.
+        protocol - Either 'usb' or 'sim'.
+        t32bin   - TRACE32 binary to launch.
+
+    Either 'name' or 'serial' is required. Targets without a protocol or a
+    t32bin use the values passed to this function. """
+
+    if tomllib is None:
+        raise ImportError("Reading a targets file requires Python 3.11+")
+
+    with open(filename, "rb") as infile:
+        config = tomllib.load(infile)
+
+    targets = []
+
+    for index, entry in enumerate(config.get("target", [])):
+        unknown = set(entry) - set(Target._fields)
+        if unknown:
+            msg = f"Unknown key(s) {sorted(unknown)} in target #{index + 1}"
+            raise ValueError(f"{filename}: {msg}")
+
+        serial = entry.get("serial")
+        name = entry.get("name", serial)
+
+        if name is None:
+            msg = f"target #{index + 1} needs a 'name' or a 'serial'"
+            raise ValueError(f"{filename}: {msg}")
+
+        target = Target(
+            name=str(name),
+            serial=None if serial is None else str(serial),
+            protocol=entry.get("protocol", protocol).lower(),
+            t32bin=entry.get("t32bin", t32bin)
+        )
+
+        if target.protocol not in ("usb", "sim"):
+            msg = f"unknown protocol [{target.protocol}] for [{target.name}]"
+            raise ValueError(f"{filename}: {msg}")
+
+        targets.append(target)
+
+    if not targets:
+        raise ValueError(f"{filename}: no [[target]] entries found")
+
+    names = [x.name for x in targets]
+    duplicates = sorted({x for x in names if names.count(x) > 1})
+    if duplicates:
+        raise ValueError(f"{filename}: duplicate target names {duplicates}")
+
+    return targets
+
+
+class QueueWriter:
+    """ Minimal write-only file object that sends each completed line to a
+    multiprocessing queue, tagged with a target name. Used as the log
+    destination inside of worker processes. """
+
+    def __init__(self, name, events):
+        self.name = name
+        self.events = events
+        self.pending = ""
+
+    def write(self, data):
+        """ Buffers 'data', and sends any completed lines. """
+
+        self.pending += data
+        *lines, self.pending = self.pending.split("\n")
+
+        for line in lines:
+            self.events.put(("log", self.name, line))
+
+        return len(data)
+
+    def flush(self):
+        """ Sends any incomplete line that's still buffered. """
+
+        if self.pending:
+            self.events.put(("log", self.name, self.pending))
+            self.pending = ""
+
+
+def _worker(function, target, args, events):
+    """ Entry-point of a worker process. Runs function(target, args, logfile)
+    and reports its outcome as a Result on the 'events' queue. """
+
+    logfile = QueueWriter(target.name, events)
+    start = time.monotonic()
+    error = None
+
+    try:
+        function(target, args, logfile)
+
+    # pylint: disable=broad-except
+    except BaseException as err:
+        error = f"{type(err).__name__}: {err}".strip()
+
+    logfile.flush()
+    runtime = time.monotonic() - start
+    events.put(("result", Result(target.name, error, runtime)))
+
+
+def _stop_workers(procs, timeout):
+    """ Waits up to 'timeout' seconds for each worker to exit, and terminates
+    any that are still running after that. """
+
+    for proc in procs:
+        proc.join(timeout=timeout)
+
+        if proc.is_alive():
+            proc.terminate()
+            proc.join()
+
+
+def fan_out(function, targets, args, logfile, poll_interval=0.1, timeout=10):
+    """ Runs function(target, args, logfile) in a separate process for every
+    target in 'targets', and waits for all of them to finish. Log lines from
+    the workers are written to 'logfile' as they arrive, prefixed with the
+    target's name. Returns a list of Results, in the same order as 'targets'.
+
+    Workers aren't daemonic, since each one starts TRACE32 (and a process to
+    quit it with). If the parent is interrupted or fails, the workers get
+    'timeout' seconds to shut down their TRACE32 before they're terminated.
+
+    'function' and 'args' must be picklable on platforms that don't fork. """
+    # pylint: disable=too-many-arguments
+
+    events = mp.Queue()
+    procs = {}
+    results = {}
+    width = max(len(x.name) for x in targets)
+
+    for target in targets:
+        proc = mp.Process(target=_worker,
+                          args=(function, target, args, events))
+        proc.start()
+        procs[target.name] = proc
+
+    def handle(event):
+        if event[0] == "log":
+            _, name, line = event
+            logfile.write(f"[{name:<{width}}] {line}\n")
+            logfile.flush()
+        else:
+            results[event[1].name] = event[1]
+
+    try:
+        while len(results) < len(targets):
+            try:
+                handle(events.get(timeout=poll_interval))
+                continue
+            except queue.Empty:
+                pass
+
+            # A worker that died without reporting (killed by a signal, for
+            # example) is recorded as a failure.
+
+            for name, proc in procs.items():
+                if name not in results and proc.exitcode is not None:
+                    try:
+                        while True:
+                            handle(events.get(timeout=poll_interval))
+                    except queue.Empty:
+                        pass
+
+                    if name not in results:
+                        msg = f"worker exited with code {proc.exitcode}"
+                        results[name] = Result(name, msg, None)
+
+    except KeyboardInterrupt:
+        # A Ctrl-C from the terminal reaches the workers too, so they're
+        # already shutting down.
+
+        _stop_workers(procs.values(), timeout)
+        raise
+
+    except BaseException:
+        for proc in procs.values():
+            if proc.is_alive():
+                os.kill(proc.pid, signal.SIGINT)
+
+        _stop_workers(procs.values(), timeout)
+        raise
+
+    _stop_workers(procs.values(), timeout)
+    return [results[x.name] for x in targets]
+
+
+def format_results(results):
+    """ Formats a list of Results into a table, and returns its lines. """
+
+    width = max([len("TARGET")] + [len(x.name) for x in results])
+    lines = [f"{'TARGET':<{width}}  RESULT  RUNTIME  ERROR"]
+
+    for result in results:
+        status = "OK" if result.error is None else "FAILED"
+
+        if result.runtime is None:
+            runtime = "-"
+        else:
+            runtime = "%.2fs" % result.runtime
+
+        lines.append(f"{result.name:<{width}}  {status:<6}  {runtime:>7}  "
+                     f"{result.error or ''}".rstrip())
+
+    return lines
+
+
+def spool(infile, dirname, filename="input.bin", blocksize=2**20):
+    """ Copies the remaining contents of 'infile' into a new file in 'dirname',
+    and returns the new file's path. Used to give every worker its own copy of
+    an input stream that can only be read once (like stdin). """
+
+    path = os.path.join(dirname, filename)
+
+    with open(path, "wb") as outfile:
+        while True:
+            block = infile.read(blocksize)
+            if not block:
+                break
+            outfile.write(block)
+
+    return path
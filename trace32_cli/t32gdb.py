@@ -0,0 +1,460 @@
+#!/usr/bin/env python3
+""" GDB remote-serial-protocol (RSP) stub that's backed by a connected
+Trace32Interface. Lets GDB (and tools built on top of it) drive TRACE32 over
+'target remote'. Memory reads go through a page cache, since GDB issues huge
+numbers of tiny reads while the target is halted. """
+
+import select
+import socket
+import time
+
+from .t32cache import PageCache
+
+# --------------------------------------------------------------------------- #
+
+# GDB register names, TRACE32 register names, and sizes (in bits) for each
+# supported architecture. The order is the order that GDB expects in 'g'
+# packets, and must match the target description that's sent to GDB.
+
+REGISTERS = {
+    "arm": (
+        [(f"r{x}", f"R{x}", 32) for x in range(13)] +
+        [("sp", "R13", 32), ("lr", "R14", 32), ("pc", "PC", 32),
+         ("cpsr", "CPSR", 32)]
+    ),
+}
+
+FEATURES = {
+    "arm": "org.gnu.gdb.arm.core",
+}
+
+# Breakpoint/watchpoint types used by Z/z packets, mapped onto Break.Set and
+# Break.Delete options.
+
+BREAK_OPTIONS = {
+    "0": "/Program",
+    "1": "/Program /Onchip",
+    "2": "/Write",
+    "3": "/Read",
+    "4": "/ReadWrite",
+}
+
+SIGTRAP = "S05"
+
+
+def _checksum(data):
+    return sum(data) & 0xFF
+
+
+def _unescape(data):
+    """ Decodes the escaped binary payload of an X packet. """
+
+    result = bytearray()
+    escaped = False
+
+    for byte in data:
+        if escaped:
+            result.append(byte ^ 0x20)
+            escaped = False
+        elif byte == 0x7D:
+            escaped = True
+        else:
+            result.append(byte)
+
+    return bytes(result)
+
+
+def target_xml(arch):
+    """ Generates a GDB target description for 'arch'. """
+
+    regs = []
+
+    for name, _, bits in REGISTERS[arch]:
+        regtype = "code_ptr" if name == "pc" else "data_ptr" \
+            if name == "sp" else "uint32"
+        regs.append(f'<reg name="{name}" bitsize="{bits}" type="{regtype}"/>')
+
+    return (
+        '<?xml version="1.0"?>'
+        '<!DOCTYPE target SYSTEM "gdb-target.dtd">'
+        f'<target><architecture>{arch}</architecture>'
+        f'<feature name="{FEATURES[arch]}">' + "".join(regs) +
+        '</feature></target>'
+    )
+
+
+class GdbServer:
+    """ Serves a single Trace32Interface to GDB clients over TCP, one client
+    at a time. Supports memory access (m/M/X), registers (g/G/p/P),
+    breakpoints and watchpoints (Z/z), and execution control (c/s, plus
+    Ctrl-C to interrupt a running target).
+
+    Memory reads are cached in pages while the target is halted. The cache
+    is dropped whenever the target runs or steps, and written ranges are
+    dropped on every memory write. """
+
+    # pylint: disable=too-many-instance-attributes
+
+    def __init__(self, iface, address=("localhost", 3333), arch="arm",
+                 log=None, page_size=1024, poll_interval=0.05):
+
+        if arch not in REGISTERS:
+            raise ValueError(f"Unsupported architecture [{arch}]")
+
+        self.iface = iface
+        self.address = address
+        self.arch = arch
+        self.registers = REGISTERS[arch]
+        self.log = log
+        self.poll_interval = poll_interval
+        self.cache = PageCache(iface.read_memory, page_size=page_size)
+        self.conn = None
+        self.ack = True
+        self.buffer = b''
+
+    def _log(self, message, level=3):
+        if self.log:
+            self.log(message, level=level)
+
+    # ----------------------------------------------------------------------- #
+
+    def _recv(self):
+        """ Receives more data from the client. Raises EOFError if the client
+        has disconnected. """
+
+        data = self.conn.recv(4096)
+        if not data:
+            raise EOFError("GDB disconnected")
+
+        self.buffer += data
+
+    def _read_packet(self):
+        """ Returns the payload of the next packet from the client. A lone
+        Ctrl-C byte is returned as b'\\x03'. """
+
+        while True:
+            self.buffer = self.buffer.lstrip(b'+')
+
+            if self.buffer[:1] == b'\x03':
+                self.buffer = self.buffer[1:]
+                return b'\x03'
+
+            start = self.buffer.find(b'$')
+            end = self.buffer.find(b'#', start + 1)
+
+            if start != -1 and end != -1 and len(self.buffer) >= end + 3:
+                payload = self.buffer[start + 1:end]
+                checksum = self.buffer[end + 1:end + 3]
+                self.buffer = self.buffer[end + 3:]
+
+                if not self.ack:
+                    return payload
+
+                try:
+                    valid = int(checksum, 16) == _checksum(payload)
+                except ValueError:
+                    valid = False
+
+                if valid:
+                    self.conn.sendall(b'+')
+                    return payload
+
+                self.conn.sendall(b'-')
+                continue
+
+            self._recv()
+
+    def _send_packet(self, payload):
+        """ Sends a packet to the client, and waits for it to be acknowledged
+        (unless no-ack mode is active). """
+
+        if isinstance(payload, str):
+            payload = payload.encode('latin-1')
+
+        packet = b'$' + payload + b'#%02x' % _checksum(payload)
+
+        while True:
+            self.conn.sendall(packet)
+
+            if not self.ack:
+                return
+
+            while not self.buffer:
+                self._recv()
+
+            reply, self.buffer = self.buffer[:1], self.buffer[1:]
+            if reply != b'-':
+                if reply != b'+':
+                    self.buffer = reply + self.buffer
+                return
+
+    # ----------------------------------------------------------------------- #
+
+    def _read_registers(self, regs):
+        """ Returns the GDB-formatted (little-endian hex) values of a list of
+        registers. """
+
+        names = [f"Register({x[1]})" for x in regs]
+        values = self.iface.eval_many(names)
+        result = []
+
+        for (_, _, bits), value in zip(regs, values):
+            result.append(int(value).to_bytes(bits // 8, 'little').hex())
+
+        return "".join(result)
+
+    def _write_registers(self, regs, data):
+        """ Writes little-endian hex values to a list of registers. """
+
+        cmds = []
+
+        for _, name, bits in regs:
+            size = bits // 4
+            value = int.from_bytes(bytes.fromhex(data[:size]), 'little')
+            data = data[size:]
+            cmds.append(f"Register.Set {name} {value:#x}")
+
+        self.iface.run_commands(cmds)
+
+    def _read_memory(self, address, length):
+        """ Reads memory through the cache. If that fails (for example, because
+        a page spans into unreadable memory), the exact range is read without
+        the cache. """
+
+        try:
+            return self.cache.read(address, length)
+        # pylint: disable=broad-except
+        except Exception:
+            return self.iface.read_memory(address, length)
+
+    def _write_memory(self, address, data):
+        self.cache.invalidate(address, len(data))
+        self.iface.write_memory(address, data)
+
+    def _running(self):
+        return bool(self.iface.eval_expression("STATE.RUN()"))
+
+    def _resume(self, command):
+        """ Runs 'command' (Go or Step), then waits for the target to halt
+        again. A Ctrl-C from GDB stops the target with a Break. """
+
+        self.cache.invalidate()
+        self.iface.run_command(command)
+
+        while self._running():
+            readable, _, _ = select.select([self.conn], [], [],
+                                           self.poll_interval)
+            if not readable:
+                continue
+
+            self._recv()
+            if b'\x03' in self.buffer:
+                self.buffer = self.buffer.replace(b'\x03', b'')
+                self.iface.run_command("Break")
+
+        self.cache.invalidate()
+        return SIGTRAP
+
+    def _breakpoint(self, payload):
+        """ Handles Z (insert) and z (remove) packets. For watchpoints, the
+        last field is the length of the watched range. """
+
+        kind, address, length = payload[1:].split(',')[:3]
+        option = BREAK_OPTIONS.get(kind)
+
+        if option is None:
+            return ""
+
+        target = f"{int(address, 16):#x}"
+
+        if kind in ("2", "3", "4"):
+            length = int(length.split(';')[0], 16)
+            if length < 1:
+                raise ValueError(f"Bad watchpoint length [{length}]")
+            target += f"++{length - 1:#x}"
+
+        if payload[0] == 'Z':
+            self.iface.run_command(f"Break.Set {target} {option}")
+        else:
+            self.iface.run_command(f"Break.Delete {target} {option}")
+
+        return "OK"
+
+    def _query(self, payload):
+        """ Handles general query packets. """
+
+        if payload.startswith("qSupported"):
+            return "PacketSize=4000;QStartNoAckMode+;qXfer:features:read+"
+
+        if payload.startswith("qXfer:features:read:target.xml:"):
+            offset, length = payload.split(":")[-1].split(",")
+            offset, length = int(offset, 16), int(length, 16)
+            xml = target_xml(self.arch)
+            chunk = xml[offset:offset + length]
+            return ("l" if offset + length >= len(xml) else "m") + chunk
+
+        if payload == "qAttached":
+            return "1"
+
+        if payload == "qfThreadInfo":
+            return "m1"
+
+        if payload == "qsThreadInfo":
+            return "l"
+
+        if payload == "qC":
+            return "QC1"
+
+        return ""
+
+    def _handle(self, payload):
+        """ Handles a single packet from GDB, and returns the reply (or None
+        if the connection should be closed). """
+        # pylint: disable=too-many-return-statements,too-many-branches
+
+        command = payload[:1]
+
+        if command == '?':
+            return SIGTRAP
+
+        if command == 'g':
+            return self._read_registers(self.registers)
+
+        if command == 'G':
+            self._write_registers(self.registers, payload[1:])
+            return "OK"
+
+        if command == 'p':
+            index = int(payload[1:], 16)
+            if index >= len(self.registers):
+                return "E01"
+            return self._read_registers([self.registers[index]])
+
+        if command == 'P':
+            index, value = payload[1:].split('=')
+            index = int(index, 16)
+            if index >= len(self.registers):
+                return "E01"
+            self._write_registers([self.registers[index]], value)
+            return "OK"
+
+        if command == 'm':
+            address, length = [int(x, 16) for x in payload[1:].split(',')]
+            return self._read_memory(address, length).hex()
+
+        if command == 'M':
+            header, data = payload[1:].split(':', 1)
+            address = int(header.split(',')[0], 16)
+            self._write_memory(address, bytes.fromhex(data))
+            return "OK"
+
+        if command in ('c', 's'):
+            return self._resume("Go" if command == 'c' else "Step")
+
+        if command in ('Z', 'z'):
+            return self._breakpoint(payload)
+
+        if command == 'H':
+            return "OK"
+
+        if command == 'T':
+            return "OK"
+
+        if command == 'D':
+            self._send_packet("OK")
+            return None
+
+        if command == 'k':
+            return None
+
+        if payload == "QStartNoAckMode":
+            self._send_packet("OK")
+            self.ack = False
+            return False
+
+        if command == 'q':
+            return self._query(payload)
+
+        return ""
+
+    def _handle_binary_write(self, payload):
+        """ Handles an X (binary memory write) packet. """
+
+        header, data = payload[1:].split(b':', 1)
+        address, length = [int(x, 16) for x in header.split(b',')]
+        data = _unescape(data)[:length]
+
+        if data:
+            self._write_memory(address, data)
+
+        return "OK"
+
+    def _service(self):
+        """ Services packets from the connected client until it detaches,
+        kills the session, or disconnects. """
+
+        while True:
+            payload = self._read_packet()
+
+            if payload == b'\x03':
+                continue
+
+            self._log(f"GDB: {payload[:64]!r}")
+
+            try:
+                if payload[:1] == b'X':
+                    reply = self._handle_binary_write(payload)
+                else:
+                    reply = self._handle(payload.decode('latin-1'))
+
+            # pylint: disable=broad-except
+            except Exception as err:
+                self._log(f"GDB: request failed ({err})", level=2)
+                reply = "E01"
+
+            if reply is None:
+                return
+
+            if reply is not False:
+                self._send_packet(reply)
+
+    def serve_forever(self):
+        """ Listens for GDB connections until a KeyboardInterrupt is
+        received. """
+
+        listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+
+        try:
+            listener.bind(self.address)
+            listener.listen(1)
+            host, port = listener.getsockname()[:2]
+            self._log(f"Listening for GDB on [{host}:{port}].", level=1)
+
+            while True:
+                conn, peer = listener.accept()
+                self._log(f"GDB connected from [{peer[0]}].", level=1)
+                conn.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+                self.conn = conn
+                self.ack = True
+                self.buffer = b''
+                self.cache.invalidate()
+                start = time.monotonic()
+
+                try:
+                    self._service()
+                except (EOFError, ConnectionError):
+                    pass
+                finally:
+                    conn.close()
+                    self.conn = None
+
+                elapsed = time.monotonic() - start
+                self._log(f"GDB disconnected after {elapsed:.1f} sec.",
+                          level=1)
+
+        except KeyboardInterrupt:
+            pass
+
+        finally:
+            listener.close()
@@ -3,19 +3,20 @@
 class that uses the lower-level Trace32API to provide a set of useful functions
 for interfacing with TRACE32. """
 
-import ctypes
 import os
 import re
 import time
 import tempfile
 import random
-import multiprocessing as mp
-import sys
+import select
+import socket
 
 
 from .t32api import Trace32API, PracticeState, MessageType, ResultType
 from .t32api import EvalError, CommandFailure, CommunicationError
 from .common import register_cleanup, make_tempdir
+from .t32cache import PageCache
+from .t32loopback import LoopbackAPI, is_loopback
 
 # --------------------------------------------------------------------------- #
 
@@ -29,46 +30,87 @@ class ScriptFailure(Exception):
         self.script = script
         self.error = error
 
+    def __reduce__(self):
+        return (self.__class__, (self.script, self.error))
+
     def __str__(self):
         return repr(self.error)
 
 
-def until_keyword(file_obj, keyword, maxblock=None, poll_rate=None):
-    """ Calls $file_obj.read() repeatedly (with an adjustable polling rate).
-    Retreives and yields as much data as possible, until $keyword is
-    encountered. Intended to be used to fetch all of file_obj's data up until
-    (but not including) $keyword. """
+def until_keyword(file_obj, keyword, maxblock=None, timeout=None,
+                  on_idle=None, initial=None):
+    """ Reads from $file_obj as data becomes available, blocking on its file
+    descriptor with poll() in-between reads. Yields the data as it arrives,
+    until $keyword is encountered. Intended to be used to fetch all of
+    file_obj's data up until (but not including) $keyword.
+
+    Each search only covers the newly-read data, plus enough of the previous
+    data to catch a keyword that was split across reads. If $initial is set,
+    it's treated as data that was read before the first read. If the keyword
+    was found, the generator's return value is whatever data was read after
+    the keyword (which might be empty). Otherwise, the return value is None.
+
+    If $timeout is set, each poll() waits for at most $timeout seconds. When a
+    wait expires, $on_idle() is called if it was supplied. If it returns True,
+    one final read is made, and the generator stops (without requiring the
+    keyword) after yielding everything it read. Without $on_idle, an expired
+    wait raises TimeoutError. """
 
-    buffer = type(file_obj.read(0))()
-    assert isinstance(keyword, type(buffer))
+    empty = type(file_obj.read(0))()
+    assert isinstance(keyword, type(empty))
 
-    # the longest match is dropped because it's tested single-case.
-    keychunks = [keyword[0:k] for k in range(1, len(keyword) + 1)]
-    keychunks = keychunks[-2::-1]
+    poller = select.poll()
+    poller.register(file_obj.fileno(), select.POLLIN)
+    wait_ms = None if timeout is None else int(timeout * 1000)
 
-    # the longest match is dropped because it's tested single-case.
-    yield buffer[0:0]
+    overlap = len(keyword) - 1
+    tail = initial if initial else empty
+    final = False
+    hangup = False
+
+    # An empty chunk is yielded first, so that the generator can be primed.
+    yield empty
 
     while True:
-        block = file_obj.read(maxblock)
-        buffer = buffer + block
-        index = buffer.find(keyword)
-
-        if index != -1:
-            yield buffer[0:index]
-            break
-
-        for keychunk in keychunks:
-            if buffer.endswith(keychunk):
-                yield buffer[0:-len(keychunk)]
-                buffer = keychunk
+        blocks = [tail]
+
+        while True:
+            block = file_obj.read(maxblock)
+            if not block:
                 break
-        else:
-            yield buffer
-            buffer = buffer[0:0]
+            blocks.append(block)
+
+        if len(blocks) > 1 or final or initial:
+            initial = None
+            data = empty.join(blocks)
+            index = data.find(keyword)
+
+            if index != -1:
+                yield data[0:index]
+                return data[index + len(keyword):]
+
+            if final:
+                yield data
+                return None
+
+            split = max(len(data) - overlap, 0)
+            if split:
+                yield data[0:split]
+            tail = data[split:]
 
-        if poll_rate is not None:
-            time.sleep(poll_rate)
+        elif hangup:
+            raise EOFError("FIFO was closed before the keyword was found.")
+
+        events = poller.poll(wait_ms)
+        hangup = any(x & select.POLLHUP for _, x in events)
+
+        if events:
+            continue
+
+        if on_idle is None:
+            raise TimeoutError(f"Timed out waiting for [{keyword}].")
+
+        final = bool(on_idle())
 
 # --------------------------------------------------------------------------- #
 
@@ -82,16 +124,42 @@ class Trace32Interface:
     handling that's necessary to automate error detection. Trace32 reports
     errors in a few different ways, all generally quite obnoxious.
 
+    In 'sequenced' mode, run_command() and eval_expression() skip the
+    per-call clear_area(). Every flag printed to the AREA carries a
+    monotonically increasing sequence number, so the FIFO never needs to be
+    reset to find the end of a command's output. The message line is only
+    re-armed with a new semaphore after something overwrites it. This cuts a
+    command from seven API calls to three, and an evaluation from six to two.
+
+    Each interface owns its own API channel (when the CAPI library supports
+    channels), so several interfaces connected to different TRACE32 instances
+    can be used side-by-side in the same process.
+
+    Memory reads can optionally be cached (see enable_cache()), for callers
+    that repeatedly inspect the same memory while the target is halted.
+
+    A libfile of "loopback" connects to an in-memory fake instead of TRACE32
+    (see t32loopback.py), for testing and benchmarking without hardware.
+
     This class can be used as a 'with' context-manager for auto-disconnect."""
 
-    # pylint: disable=too-many-instance-attributes
+    # pylint: disable=too-many-instance-attributes,too-many-arguments
 
-    def __init__(self, libfile=None, tempdir=None, port=None, node=None):
+    def __init__(self, libfile=None, tempdir=None, port=None, node=None,
+                 sequenced=False, packlen=None):
 
-        self.api = Trace32API(libfile)
+        self.loopback = is_loopback(libfile)
+
+        if self.loopback:
+            self.api = LoopbackAPI.from_libfile(libfile)
+        else:
+            self.api = Trace32API(libfile)
 
         self.area = None
         self.connected = False
+        self.sequenced = sequenced
+        self._sequence = 0
+        self._msgline = None
 
         if tempdir is None:
             self._tempdir_obj = make_tempdir()
@@ -107,9 +175,13 @@ class Trace32Interface:
         self.fifo_name = fifo_name
         self.node = node
         self.port = port
-        self.packlen = None
+        self.packlen = packlen
         self.libfile = libfile
 
+        self.cache = None
+        self.noncacheable = []
+        self._bypassed = 0
+
     def __enter__(self):
         kwargs = {}
         if self.node:
@@ -118,6 +190,9 @@ class Trace32Interface:
         if self.port:
             kwargs['port'] = self.port
 
+        if self.packlen:
+            kwargs['packlen'] = self.packlen
+
         self.connect(**kwargs)
         return self
 
@@ -128,23 +203,16 @@ class Trace32Interface:
             self.api.T32_Exit()
 
     @staticmethod
-    def _try_attach(libfile, node, port, packlen):
-        """ Utility function that initializes a Trace32 API session and then
-        closes it. Intended to be used as a background task to validate
-        connectivity with Trace32. """
-        try:
-            api = Trace32API(libfile)
-            api.T32_Config("NODE=", node)
-            api.T32_Config("PORT=", port)
-
-            if packlen:
-                api.T32_Config("PACKLEN=", packlen)
+    def _port_ready(node, port, timeout=0.05):
+        """ Checks whether Trace32's RCL port is accepting TCP connections.
+        Used to find out when a freshly-launched Trace32 is ready for
+        T32_Init(), without risking a hung API call. """
 
-            api.T32_Init()
-            api.T32_Attach()
-            api.T32_Exit()
-        except CommunicationError:
-            sys.exit(1)
+        try:
+            with socket.create_connection((node, port), timeout=timeout):
+                return True
+        except OSError:
+            return False
 
     def connect(self, node="localhost", port=20000, packlen=None, timeout=10):
         """ Connect to a Trace32 instance. """
@@ -181,29 +249,13 @@ class Trace32Interface:
         """ Connect to a Trace32 instance. """
 
         timeout_time = time.time() + timeout
+        loopback = isinstance(self.api, LoopbackAPI)
 
-        while True:
+        while not loopback and not self._port_ready(self.node, self.port):
             if time.time() > timeout_time:
                 raise CommunicationError("init/attach timeout", 1)
 
-            args = (self.libfile, self.node, self.port, self.packlen)
-            proc = mp.Process(target=self._try_attach, args=args, daemon=True)
-            proc.start()
-            attach_timeout = time.time() + 0.5
-            while True:
-                if (time.time() > attach_timeout) or not proc.is_alive():
-                    break
-
-                if time.time() > timeout_time:
-                    raise CommunicationError("init/attach timeout", 1)
-
-                time.sleep(0.01)
-
-            if proc.is_alive():
-                proc.terminate()
-
-            elif proc.exitcode == 0:
-                break
+            time.sleep(0.005)
 
         self.api.T32_Config("NODE=", self.node)
         self.api.T32_Config("PORT=", self.port)
@@ -234,21 +286,6 @@ class Trace32Interface:
         self.api.T32_Ping()
         self.connected = True
 
-    def _reconnect(self):
-        """ Reconnect to a preconfigured to a Trace32 instance. """
-
-        self.api.T32_Config("NODE=", self.node)
-        self.api.T32_Config("PORT=", self.port)
-
-        if self.packlen:
-            self.api.T32_Config("PACKLEN=", self.packlen)
-
-        self.api.T32_Init()
-        self.api.T32_Attach()
-        self.api.T32_Ping()
-
-        self.connected = True
-
     def disconnect(self, shutdown=False, exit_code=None):
         """ Disconnect from a Trace32 instance. """
 
@@ -277,34 +314,217 @@ class Trace32Interface:
         """ Checks to make sure that the API is connected and active. """
         self.api.T32_Ping()
 
+    def reset(self, system_down=True):
+        """ Returns the connected TRACE32 to a clean state, so that it can be
+        reused for an unrelated job. Stops any running PRACTICE script and
+        empties the PRACTICE stack, optionally takes the target system down,
+        and clears the AREA. """
+
+        self.api.T32_Stop()
+        self.api.T32_Cmd("END")
+
+        if self.api.T32_GetPracticeState() != PracticeState.Idle:
+            raise CommandFailure("END", "PRACTICE didn't return to idle")
+
+        if system_down:
+            self.api.T32_Cmd("SYStem.Down")
+
+        self.clear_area()
+
+    def enable_cache(self, page_size=4096, max_pages=4096, noncacheable=()):
+        """ Turns on a page-granular cache for read_memory(). Up to
+        'max_pages' pages of 'page_size' bytes are kept. 'noncacheable' is a
+        list of (address, length) ranges (like peripheral registers) that are
+        always read from the target. Pages that overlap those ranges are
+        never cached either.
+
+        The cache is dropped whenever a command runs (which includes scripts)
+        or the CPU is halted or reset through the API. Written ranges are
+        dropped by write_memory() and write_many(). Memory that's changed
+        behind TRACE32's back (by a running core or a DMA, for example) isn't
+        noticed, so the cache is only meant for use while the target is
+        halted. """
+
+        self.disable_cache()
+        self.cache = PageCache(self._read_uncached, page_size, max_pages)
+        self.noncacheable = [(x, x + y) for x, y in noncacheable]
+        self._bypassed = 0
+        self.api.change_hooks.append(self.invalidate_cache)
+
+    def disable_cache(self):
+        """ Turns off the read_memory() cache, and drops its contents. """
+
+        if self.cache is not None:
+            self.api.change_hooks.remove(self.invalidate_cache)
+            self.cache = None
+
+    def invalidate_cache(self, address=None, length=None):
+        """ Drops a range of memory (or everything, if no range is given)
+        from the read_memory() cache. """
+
+        if self.cache is not None:
+            self.cache.invalidate(address, length)
+
+    def cache_stats(self):
+        """ Returns a dict of cache metrics: page hits and misses, the number
+        of reads that were issued to fill misses, the number of reads that
+        bypassed the cache, and the number of pages that are cached. Returns
+        None if the cache is off. """
+
+        if self.cache is None:
+            return None
+
+        return {
+            'hits': self.cache.hits,
+            'misses': self.cache.misses,
+            'fetches': self.cache.fetches,
+            'bypassed': self._bypassed,
+            'pages': len(self.cache.pages)
+        }
+
+    def _read_uncached(self, address, length):
+        return self.api.read_memory(address, None, length)
+
+    def _cacheable(self, address, length):
+        """ Checks whether every page that a read would fetch is outside of
+        the non-cacheable ranges. """
+
+        mask = self.cache.page_size - 1
+        start = address & ~mask
+        end = (address + length + mask) & ~mask
+
+        for low, high in self.noncacheable:
+            if start < high and low < end:
+                return False
+
+        return True
+
     def read_memory(self, address, length, address_width=None):
         """ Reads a block of data from the target's memory-space and
         returns it. Set address_width to 32 or 64 for an explicit value,
-        or else it'll be auto-determined. """
+        or else it'll be auto-determined. Reads with an explicit
+        address_width always bypass the cache. """
+
+        if self.cache is not None:
+            if address_width is None and self._cacheable(address, length):
+                return self.cache.read(address, length)
 
-        if address_width is None:
-            if address >= 2**32:
-                address_width = 64
-            else:
-                address_width = 32
+            self._bypassed += 1
 
-        buffer = ctypes.create_string_buffer(length)
-        self.api.dll.read_memory(address, address_width, buffer, length)
-        return buffer.raw
+        return self.api.read_memory(address, address_width, length)
+
+    def read_memory_into(self, address, buffer, address_width=None):
+        """ Reads a block of data from the target's memory-space directly into
+        'buffer', which can be any writable object that supports the buffer
+        protocol (bytearray, memoryview, mmap, etc). The size of the read is
+        the size of 'buffer'. Returns the number of bytes read. This is meant
+        for bulk transfers, so it never goes through the cache. """
+
+        return self.api.read_memory_into(address, address_width, buffer)
 
     def write_memory(self, address, data, address_width=None):
         """ Writes a block of data to the target's memory-space. Set
         address_width to 32 or 64 for an explicit value, or else it'll be
         auto-determined. """
 
-        if address_width is None:
-            if address >= 2**32:
-                address_width = 64
-            else:
-                address_width = 32
+        assert isinstance(data, (bytes, bytearray, memoryview))
+        self.invalidate_cache(address, len(data))
+        self.api.write_memory(address, address_width, data)
+
+    def crc32(self, address, length):
+        """ Computes the CRC32 of 'length' bytes of target memory starting at
+        'address', and returns it. The checksum is calculated by TRACE32 (with
+        Data.SUM /CRC32), so only the result is transferred. The result is
+        comparable to zlib.crc32() of the same data. """
+
+        self.run_command(f"Data.SUM {address:#x}++{length - 1:#x} /CRC32")
+        return self.eval_expression("Data.SUM()") & 0xFFFFFFFF
+
+    def _request_address(self, address):
+        """ Allocates an address object for 'address', with a width that's
+        auto-determined from the address. """
+
+        if address >= 2**32:
+            return self.api.T32_RequestAddressObjA64(address)
+
+        return self.api.T32_RequestAddressObjA32(address)
+
+    def read_many(self, requests):
+        """ Reads a list of (address, length) blocks from the target's
+        memory-space using a single bundled access, so that the whole list
+        costs one round trip. Returns a list of the data blocks, in the same
+        order as the requests. """
+
+        requests = list(requests)
+        if not requests:
+            return []
+
+        buffers = []
+        addresses = []
+        bundle = self.api.T32_BundledAccessAlloc()
 
-        assert isinstance(data, bytes)
-        self.api.dll.write_memory(address, address_width, data, len(data))
+        try:
+            for address, length in requests:
+                buffers.append(self.api.T32_RequestBufferObj(length))
+                addresses.append(self._request_address(address))
+                self.api.T32_ReadMemoryObj(buffers[-1], addresses[-1], length)
+
+            self.api.T32_BundledAccessExecute(bundle)
+
+            return [self.api.T32_CopyDataFromBufferObj(buffer, length)
+                    for buffer, (_, length) in zip(buffers, requests)]
+
+        finally:
+            self.api.T32_BundledAccessFree(bundle)
+
+            for handle in buffers:
+                self.api.T32_ReleaseBufferObj(handle)
+
+            for handle in addresses:
+                self.api.T32_ReleaseAddressObj(handle)
+
+    def write_many(self, blocks):
+        """ Writes a list of (address, data) blocks to the target's
+        memory-space using a single bundled access, so that the whole list
+        costs one round trip. """
+
+        blocks = list(blocks)
+        if not blocks:
+            return
+
+        for address, data in blocks:
+            self.invalidate_cache(address, len(data))
+
+        buffers = []
+        addresses = []
+        bundle = self.api.T32_BundledAccessAlloc()
+
+        try:
+            for address, data in blocks:
+                buffers.append(self.api.T32_RequestBufferObj(len(data)))
+                addresses.append(self._request_address(address))
+                self.api.T32_CopyDataToBufferObj(buffers[-1], data)
+                self.api.T32_WriteMemoryObj(buffers[-1], addresses[-1],
+                                            len(data))
+
+            self.api.T32_BundledAccessExecute(bundle)
+
+        finally:
+            self.api.T32_BundledAccessFree(bundle)
+
+            for handle in buffers:
+                self.api.T32_ReleaseBufferObj(handle)
+
+            for handle in addresses:
+                self.api.T32_ReleaseAddressObj(handle)
+
+    def _next_flag(self):
+        """ Returns a new flag-value for marking a position in the AREA's
+        output. Flags are unique to this connection, and increase
+        monotonically. """
+
+        self._sequence += 1
+        return f"{self.area}{self._sequence:08X}"
 
     def clear_area(self):
         """ Clears the current AREA, and drops any data pending in the input
@@ -312,43 +532,77 @@ class Trace32Interface:
         a detectable flag-value, and return that value. """
 
         self.api.T32_Cmd(f"AREA.CLEAR {self.area}")
+        return self._arm_msgline()
+
+    def _arm_msgline(self):
+        """ Selects the AREA, drops any data pending in the input FIFO, and
+        sets the message-string to a detectable flag-value. Returns that
+        value. """
+
         self.api.T32_Cmd(f"AREA.Select {self.area}")
         while self.fifo.read(4096):
             pass
 
-        chars = [chr(random.randint(ord('A'), ord('Z'))) for _ in range(16)]
-        flag_message = f"Semaphore {''.join(chars)}"
-        self.api.T32_Cmd(f'Print %AREA A000 "{flag_message}"')
+        flag_message = self._rearm_msgline()
         message_string = self.api.T32_GetMessageString()
         assert message_string['msg'] == flag_message
         return flag_message
 
+    def _rearm_msgline(self):
+        """ Puts a new flag-value on the message-string, without touching the
+        AREA or the input FIFO, and returns it. Used in the middle of a batch
+        so that a message that repeats the previous one is still detected. """
+
+        flag_message = f"Semaphore {self._next_flag()}"
+        self.api.T32_Cmd(f'Print %AREA A000 "{flag_message}"')
+        self._msgline = flag_message
+        return flag_message
+
     @staticmethod
-    def _wait_idle(libfile, node, port, packlen):
-        """ Creates a new API instance and uses it to poll the
-        T32_GetPracticeState function.  Blocks until T32_GetPracticeState()
-        returns Idle. This function is intended to be used in a background
-        thread/process, while the main API is disconnected. """
+    def _collect(fetcher, logfile=None):
+        """ Runs an until_keyword() generator to completion, writing its
+        output to $logfile as it's received. Returns a tuple of the output,
+        and the generator's return value. """
 
-        api = Trace32API(libfile)
-        api.T32_Config("NODE=", node)
-        api.T32_Config("PORT=", port)
-        if packlen:
-            api.T32_Config("PACKLEN=", packlen)
+        chunks = []
 
-        api.T32_Init()
+        while True:
+            try:
+                chunk = next(fetcher)
+            except StopIteration as stop:
+                return ("".join(chunks), stop.value)
 
-        try:
-            while True:
-                practice_state = api.T32_GetPracticeState()
-                if practice_state == PracticeState.Idle:
-                    break
+            if logfile:
+                logfile.write(chunk)
+            chunks.append(chunk)
 
-                time.sleep(0.01)
-        except KeyboardInterrupt:
+    def _msgline_flag(self):
+        """ Returns a flag-value that's currently on the message line, so that
+        any new message can be detected. In sequenced mode, the last flag is
+        reused for as long as nothing has overwritten it. """
+
+        if not self.sequenced:
+            return self.clear_area()
+
+        if self._msgline is None:
+            return self._arm_msgline()
+
+        while self.fifo.read(4096):
             pass
 
-        api.T32_Exit()
+        return self._msgline
+
+    def _check_msgline(self, msgline_flag):
+        """ Reads the message line, and returns its message-string if it's
+        been changed from $msgline_flag. Returns None otherwise. """
+
+        message_string = self.api.T32_GetMessageString()
+
+        if message_string['msg'] == msgline_flag:
+            return None
+
+        self._msgline = None
+        return message_string
 
     @staticmethod
     def _validate_script(scriptfile):
@@ -365,81 +619,61 @@ class Trace32Interface:
     def run_file(self, scriptfile, args=(), logfile=None):
         """ Run a PRACTICE script that exists on the filesystem. """
 
-        buffer = ""
         self._validate_script(scriptfile)
         msgline_flag = self.clear_area()
 
+        # The script is launched from a small wrapper script that prints a
+        # flag to the AREA once the script returns. Seeing the flag on
+        # the FIFO means that the script has finished, and that all of its
+        # output has been captured. If the script never returns to the
+        # wrapper (because of an error or an END statement), then PRACTICE
+        # goes idle without printing the flag. T32_GetPracticeState() is
+        # checked whenever the FIFO goes quiet for 250ms to catch that case.
+
+        flag = self._next_flag()
+
         cmd = f"DO {os.path.abspath(scriptfile)}"
         if args:
             cmd += " " + " ".join(args)
 
-        self.api.T32_ExecuteCommand(cmd)
-
-        # A background task is used to poll Trace32 and wait until the script
-        # exits. This allows us to continue retrieving FIFO data while the
-        # script runs, and is necessary because some Trace32 operations can
-        # block its ability to respond to API calls.
+        wrapper = f'{cmd}\nPRINT %AREA {self.area} "{flag}"\nENDDO\n'
 
-        # To accomplish this, the main API is shut down with T32_Exit() so that
-        # it's available to the background task. Then, it's re-initialized
-        # after the background task is completed.
-
-        self.api.T32_Exit()
-        self.connected = False
-        caught_exception = None
+        def script_idle():
+            return self.api.T32_GetPracticeState() == PracticeState.Idle
 
-        args = (self.libfile, self.node, self.port, self.packlen)
-        proc = mp.Process(target=self._wait_idle, args=args, daemon=True)
-        proc.start()
-
-        try:
-            while True:
-                output = self.fifo.read(4096)
+        with tempfile.NamedTemporaryFile(dir=self.tempdir, suffix=".cmm",
+                                         mode="w+") as wrapper_file:
+            wrapper_file.write(wrapper)
+            wrapper_file.flush()
+            self.api.T32_ExecuteCommand(f"DO {wrapper_file.name}")
+
+            fetcher = until_keyword(self.fifo, flag, maxblock=4096,
+                                    timeout=0.25, on_idle=script_idle)
+            output, leftover = self._collect(fetcher, logfile)
+            chunks = [output]
+
+        if leftover is None:
+            # The script exited without reaching the wrapper's flag. A new
+            # flag is printed to the AREA and detected using until_keyword(),
+            # as a reliable means to make sure that we've captured all of the
+            # script's output data.
+
+            flag = self._next_flag()
+            self.api.T32_Cmd(f'PRINT %AREA {self.area} "{flag}"')
+
+            for chunk in until_keyword(self.fifo, flag, maxblock=4096):
                 if logfile:
-                    logfile.write(output)
-                buffer += output
-
-                if not proc.is_alive():
-                    break
+                    logfile.write(chunk)
 
-                time.sleep(0.025)
-
-        # pylint: disable=broad-except
-        except Exception as err:
-            caught_exception = err
-
-        # At the conclusion of proc.is_alive(), Trace32 has reported that the
-        # script is finished (or there was an abnormal exit of some kind).
-        # The proc is expliticly terminated as a just-in-case, and then the API
-        # is re-initialized.
-
-        proc.terminate()
-        self._reconnect()
-
-        if caught_exception:
-            raise caught_exception
-
-        # After running the script, a random string is generated and printed
-        # to the Trace32 AREA. This flag is then detected using until_keyword()
-        # as a reliable means to make sure that we've captured all of the
-        # script's output data.
-
-        flag = [chr(random.randint(ord('A'), ord('Z'))) for _ in range(16)]
-        flag = "".join(flag)
-        self.api.T32_Cmd(f'PRINT %AREA {self.area} "{flag}"')
-
-        for chunk in until_keyword(self.fifo, flag, maxblock=4096,
-                                   poll_rate=0.05):
-            if logfile:
-                logfile.write(chunk)
+                chunks.append(chunk)
 
-            buffer += chunk
+        buffer = "".join(chunks)
 
         while self.fifo.read(4096):
             pass
 
-        message_string = self.api.T32_GetMessageString()
-        if message_string['msg'] != msgline_flag:
+        message_string = self._check_msgline(msgline_flag)
+        if message_string:
             buffer += "\n" + message_string['msg']
             err_types = [MessageType.Error, MessageType.Error_Info]
             if [x for x in message_string['types'] if x in err_types]:
@@ -471,24 +705,25 @@ class Trace32Interface:
         """ Run a single command and return the result. Optionally, also write
         the result to a logfile as its received. """
 
-        msgline_flag = self.clear_area()
-        while self.fifo.read(4096):
-            pass
+        msgline_flag = self._msgline_flag()
 
-        self.api.T32_ExecuteCommand(cmd)
+        try:
+            self.api.T32_ExecuteCommand(cmd)
+        except Exception:
+            self._msgline = None
+            raise
 
-        flag = [chr(random.randint(ord('A'), ord('Z'))) for _ in range(16)]
-        flag = "".join(flag)
+        flag = self._next_flag()
         self.api.T32_Cmd(f'PRINT %AREA {self.area} "{flag}"')
 
-        fetcher = until_keyword(self.fifo, flag, maxblock=4096,
-                                poll_rate=0.05)
-        buffer = ""
-        for chunk in fetcher:
+        chunks = []
+        for chunk in until_keyword(self.fifo, flag, maxblock=4096):
             if logfile:
                 logfile.write(chunk)
 
-            buffer += chunk
+            chunks.append(chunk)
+
+        buffer = "".join(chunks)
 
         while self.fifo.read(4096):
             pass
@@ -497,9 +732,9 @@ class Trace32Interface:
             if len(buffer) > 1 and buffer[-1] != '\n':
                 logfile.write('\n')
 
-        message_string = self.api.T32_GetMessageString()
+        message_string = self._check_msgline(msgline_flag)
 
-        if message_string['msg'] != msgline_flag:
+        if message_string:
             err_types = [MessageType.Error, MessageType.Error_Info]
             if [x for x in message_string['types'] if x in err_types]:
                 raise CommandFailure(cmd, message_string['msg'].strip())
@@ -511,6 +746,83 @@ class Trace32Interface:
 
         return buffer
 
+    def run_commands(self, cmds, logfile=None):
+        """ Run a list of commands back-to-back, and return a list of their
+        results. Optionally, also write the results to a logfile as they're
+        received.
+
+        Nothing waits on the AREA in-between commands. Instead, a flag is
+        printed after each command to mark where its output ends, and the
+        whole batch is collected once the last flag arrives. Messages are
+        taken from each command's T32_ExecuteCommand() response, and the
+        message line is checked after each command, so that an error is
+        blamed on the command that caused it. The batch stops at the first
+        failing command, and a CommandFailure is raised for it once the
+        output of every command up to it has been collected. """
+
+        last_message = self._msgline_flag()
+        err_types = [MessageType.Error, MessageType.Error_Info]
+        batch = []
+        failure = None
+
+        try:
+            for cmd in cmds:
+                try:
+                    message = self.api.T32_ExecuteCommand(cmd).strip()
+                except CommandFailure as err:
+                    failure = err
+                    message = None
+
+                if failure is None:
+                    message_string = self.api.T32_GetMessageString()
+
+                    if message_string['msg'] != last_message:
+                        if [x for x in message_string['types']
+                                if x in err_types]:
+                            failure = CommandFailure(
+                                cmd, message_string['msg'].strip())
+                        else:
+                            last_message = self._rearm_msgline()
+
+                flag = self._next_flag()
+                self.api.T32_Cmd(f'PRINT %AREA {self.area} "{flag}"')
+                batch.append((cmd, flag, message))
+
+                if failure:
+                    break
+
+        except Exception:
+            self._msgline = None
+            raise
+
+        results = []
+        leftover = ""
+
+        for cmd, flag, message in batch:
+            if leftover.startswith('\n'):
+                leftover = leftover[1:]
+
+            fetcher = until_keyword(self.fifo, flag, maxblock=4096,
+                                    initial=leftover)
+            buffer, leftover = self._collect(fetcher, logfile)
+            results.append(buffer)
+
+            if logfile:
+                if len(buffer) > 1 and buffer[-1] != '\n':
+                    logfile.write('\n')
+
+                if message:
+                    logfile.write(message + '\n')
+
+        while self.fifo.read(4096):
+            pass
+
+        if failure:
+            self._msgline = None
+            raise failure
+
+        return results
+
     @staticmethod
     def _decode_eval_result(result):
         """ Decode the result from a call to T32_ExecuteFunction() into a
@@ -550,11 +862,16 @@ class Trace32Interface:
         """ Run a single command and return the result. Optionally, also write
         the result to a logfile as its received. """
 
-        msgline_flag = self.clear_area()
-        result = self.api.T32_ExecuteFunction(expression)
+        msgline_flag = self._msgline_flag()
 
-        message_string = self.api.T32_GetMessageString()
-        if message_string['msg'] != msgline_flag:
+        try:
+            result = self.api.T32_ExecuteFunction(expression)
+        except Exception:
+            self._msgline = None
+            raise
+
+        message_string = self._check_msgline(msgline_flag)
+        if message_string:
             err_types = [MessageType.Error, MessageType.Error_Info]
             if [x for x in message_string['types'] if x in err_types]:
                 raise EvalError(message_string['msg'], expression)
@@ -569,3 +886,47 @@ class Trace32Interface:
             return result
 
         return self._decode_eval_result(result)
+
+    def eval_many(self, expressions, decode=True, logfile=None):
+        """ Evaluate a list of expressions, and return a list of their
+        results. Optionally, also write the results to a logfile as they're
+        received.
+
+        The message line is only set up once for the whole list. After that,
+        a new message is detected by comparing against the last message that
+        was seen, so an evaluation costs two API calls instead of six. After
+        a message that isn't an error, the message line is re-armed, so that
+        an identical message from a later expression is still detected. The
+        list stops at the first expression that reports an error. """
+
+        last_message = self._msgline_flag()
+        err_types = [MessageType.Error, MessageType.Error_Info]
+        results = []
+
+        try:
+            for expression in expressions:
+                result = self.api.T32_ExecuteFunction(expression)
+                message_string = self.api.T32_GetMessageString()
+
+                if message_string['msg'] != last_message:
+                    if [x for x in message_string['types'] if x in err_types]:
+                        raise EvalError(message_string['msg'], expression)
+
+                    last_message = self._rearm_msgline()
+
+                if logfile:
+                    logfile.write(result['msg'])
+
+                    if len(result['msg']) > 1 and result['msg'][-1] != '\n':
+                        logfile.write('\n')
+
+                if decode:
+                    result = self._decode_eval_result(result)
+
+                results.append(result)
+
+        except Exception:
+            self._msgline = None
+            raise
+
+        return results
@@ -0,0 +1,501 @@
+#!/usr/bin/env python3
+""" Loopback stand-in for Trace32API, so that the rest of the library can be
+tested and benchmarked without TRACE32 or any hardware. It implements the
+T32_* wrappers and memory functions against an in-memory target, and writes
+AREA output to the AREA's FIFO just like TRACE32 does.
+
+Select it by passing a libfile of "loopback" to Trace32Interface (or to the
+CLI's --libfile). Per-call latency and bandwidth can be added to mimic a real
+probe, like: "loopback:latency=200e-6,bandwidth=8e6". Every instance starts
+with an empty target, so use the CLI's 'serve' command to share one between
+several CLI invocations. """
+
+import collections
+import fcntl
+import os
+import re
+import shlex
+import time
+import zlib
+
+from .t32api import MessageType, PracticeState, ResultType
+from .t32api import CommandFailure, EvalError
+
+# --------------------------------------------------------------------------- #
+
+LOOPBACK = "loopback"
+
+
+def is_loopback(libfile):
+    """ Checks whether 'libfile' selects the loopback API. """
+
+    return isinstance(libfile, str) and \
+        (libfile == LOOPBACK or libfile.startswith(LOOPBACK + ":"))
+
+
+def _number(text):
+    """ Parses a number in PRACTICE syntax. Numbers are hexadecimal unless
+    they have a trailing '.', which makes them decimal. """
+
+    text = text.strip()
+
+    if text.endswith("."):
+        return int(text[:-1], 10)
+
+    return int(text, 16)
+
+
+class LoopbackTarget:
+    """ Sparse in-memory target. Memory that was never written reads back as
+    zeros. """
+
+    PAGE_SIZE = 2**16
+
+    def __init__(self):
+        self.pages = {}
+
+    def _chunks(self, address, length):
+        """ Splits a range into (page, offset, start, size) pieces, where
+        'start' is the position of each piece within the range. """
+
+        start = 0
+
+        while start < length:
+            base, offset = divmod(address + start, self.PAGE_SIZE)
+            size = min(self.PAGE_SIZE - offset, length - start)
+            yield base, offset, start, size
+            start += size
+
+    def read(self, address, length):
+        """ Returns 'length' bytes of memory starting at 'address'. """
+
+        result = bytearray(length)
+
+        for base, offset, start, size in self._chunks(address, length):
+            page = self.pages.get(base)
+            if page is not None:
+                result[start:start + size] = page[offset:offset + size]
+
+        return bytes(result)
+
+    def write(self, address, data):
+        """ Writes 'data' to memory starting at 'address'. """
+
+        data = memoryview(data).cast('B')
+
+        for base, offset, start, size in self._chunks(address, len(data)):
+            page = self.pages.get(base)
+            if page is None:
+                page = self.pages[base] = bytearray(self.PAGE_SIZE)
+            page[offset:offset + size] = data[start:start + size]
+
+
+class LoopbackAPI:
+    """ Drop-in replacement for Trace32API that doesn't talk to TRACE32.
+
+    Commands are interpreted just enough for Trace32Interface: AREA setup,
+    PRINT (to an AREA or to the message line), DO (scripts run synchronously,
+    line-by-line), Data.SUM, Data.LOAD.Binary, Register.Set, and Eval. Other
+    commands succeed without doing anything. Commands in 'failures' (matched
+    by their first word, case-insensitively) fail with a CommandFailure, for
+    testing error paths. Expressions support numeric literals, Data.SUM(),
+    Register(), STATE.RUN(), and EVAL(); others raise an EvalError.
+
+    Every call sleeps for 'latency' seconds, and memory transfers (including
+    Data.LOAD.Binary) also take len/bandwidth seconds (if 'bandwidth' is set,
+    in bytes/sec). Calls are counted by name in 'calls'. """
+
+    # pylint: disable=invalid-name,too-many-instance-attributes
+
+    def __init__(self, latency=0.0, bandwidth=None, target=None):
+        self.latency = latency
+        self.bandwidth = bandwidth
+        self.target = target or LoopbackTarget()
+        self.calls = collections.Counter()
+        self.change_hooks = []
+        self.failures = set()
+        self.channel = None
+        self.native = None
+        self.config = {}
+        self.connected = False
+        self.registers = collections.defaultdict(int)
+        self.areas = {}
+        self.selected = None
+        self.message = ("", MessageType.Ignore)
+        self.checksum = 0
+        self.eval_result = 0
+        self._bundle = None
+
+    @classmethod
+    def from_libfile(cls, libfile):
+        """ Creates an instance from a libfile string, like
+        "loopback:latency=1e-4,bandwidth=8e6". """
+
+        _, _, spec = libfile.partition(":")
+        kwargs = {}
+
+        for item in filter(None, spec.split(",")):
+            key, _, value = item.partition("=")
+            key = key.strip()
+
+            if key not in ("latency", "bandwidth"):
+                raise ValueError(f"Unknown loopback setting [{key}]")
+
+            kwargs[key] = float(value)
+
+        return cls(**kwargs)
+
+    def _call(self, name, nbytes=0):
+        """ Counts a call, and waits for the simulated latency. """
+
+        self.calls[name] += 1
+        delay = self.latency
+
+        if nbytes and self.bandwidth:
+            delay += nbytes / self.bandwidth
+
+        if delay > 0:
+            time.sleep(delay)
+
+    def _target_changed(self):
+        for hook in self.change_hooks:
+            hook()
+
+    # ----------------------------------------------------------------------- #
+
+    def _print(self, area, text):
+        """ Writes a line of text to an AREA, or to the message line. """
+
+        if area.upper() == "A000":
+            self.message = (text, MessageType.General_Info)
+            return
+
+        fileno = self.areas.get(area.upper())
+        if fileno is not None:
+            os.write(fileno, (text + "\n").encode("latin-1"))
+
+    def _open_area(self, area, filename):
+        """ Connects an AREA to a file (usually the interface's FIFO). The
+        FIFO is opened without blocking (so that a missing reader is an error
+        instead of a hang), and then switched to blocking writes. """
+
+        self._close_area(area)
+        fileno = os.open(filename, os.O_WRONLY | os.O_APPEND | os.O_NONBLOCK)
+        flags = fcntl.fcntl(fileno, fcntl.F_GETFL)
+        fcntl.fcntl(fileno, fcntl.F_SETFL, flags & ~os.O_NONBLOCK)
+        self.areas[area.upper()] = fileno
+
+    def _close_area(self, area):
+        fileno = self.areas.pop(area.upper(), None)
+        if fileno is not None:
+            os.close(fileno)
+
+    def _run_script(self, filename):
+        """ Runs a PRACTICE script, one command per line, until ENDDO. """
+
+        with open(filename, encoding="latin-1") as infile:
+            lines = infile.read().splitlines()
+
+        for line in lines:
+            line = line.strip()
+
+            if not line or line.startswith(";"):
+                continue
+
+            if line.upper().startswith("ENDDO"):
+                return
+
+            self._execute(line)
+
+    def _load_binary(self, args):
+        """ Handles Data.LOAD.Binary FILE START++SIZE [/SKIP N] [...]. """
+
+        words = shlex.split(args)
+        filename = words[0]
+        start, size = words[1].split("++")
+        start, size = _number(start), _number(size) + 1
+        skip = 0
+
+        for index, word in enumerate(words):
+            if word.upper() == "/SKIP":
+                skip = _number(words[index + 1])
+
+        with open(filename, "rb") as infile:
+            infile.seek(skip)
+            self.target.write(start, infile.read(size))
+
+        if self.bandwidth:
+            time.sleep(size / self.bandwidth)
+
+    def _execute(self, cmd):
+        """ Interprets a single command. """
+        # pylint: disable=too-many-branches
+
+        cmd = cmd.strip()
+        if not cmd:
+            return
+
+        word, _, args = cmd.partition(" ")
+        name = word.upper()
+        args = args.strip()
+
+        if name in self.failures:
+            self.message = (f"{word}: failed", MessageType.Error)
+            raise CommandFailure(cmd, self.message[0])
+
+        if name == "PRINT":
+            match = re.match(r'%AREA\s+(\S+)\s+"(.*)"$', args, re.I)
+            if match:
+                self._print(match.group(1), match.group(2))
+            elif self.selected:
+                self._print(self.selected, args.strip('"'))
+
+        elif name == "AREA.OPEN":
+            area, filename = args.split()[:2]
+            self._open_area(area, filename)
+
+        elif name == "AREA.SELECT":
+            self.selected = args.split()[0]
+
+        elif name in ("AREA.CLOSE", "AREA.DELETE"):
+            self._close_area(args.split()[0])
+
+        elif name == "DO":
+            self._run_script(shlex.split(args)[0])
+
+        elif name == "DATA.SUM":
+            start, size = args.split()[0].split("++")
+            data = self.target.read(_number(start), _number(size) + 1)
+            self.checksum = zlib.crc32(data)
+
+        elif name == "DATA.LOAD.BINARY":
+            self._load_binary(args)
+
+        elif name == "REGISTER.SET":
+            register, value = args.split()[:2]
+            self.registers[register.upper()] = _number(value)
+
+        elif name == "EVAL":
+            self.eval_result = self._evaluate(args)[0]
+
+    def _evaluate(self, expression):
+        """ Evaluates an expression, and returns a (value, ResultType)
+        tuple. """
+
+        text = expression.strip()
+        upper = text.upper()
+
+        if upper == "DATA.SUM()":
+            return (self.checksum, ResultType.Hexadecimal)
+
+        if upper == "STATE.RUN()":
+            return (False, ResultType.Boolean)
+
+        match = re.match(r"(?:REGISTER|EVAL)\((.*)\)$", upper)
+        if match and upper.startswith("REGISTER"):
+            return (self.registers[match.group(1)], ResultType.Hexadecimal)
+
+        if match:
+            return (self.eval_result, ResultType.Hexadecimal)
+
+        try:
+            value = _number(text)
+        except ValueError:
+            value = None
+
+        if value is not None:
+            if text.endswith("."):
+                return (value, ResultType.Decimal)
+
+            return (value, ResultType.Hexadecimal)
+
+        raise EvalError("unknown expression (loopback)", expression)
+
+    # ----------------------------------------------------------------------- #
+
+    def T32_Config(self, key, value):
+        self._call("T32_Config")
+        self.config[key.upper().rstrip("=")] = value
+
+    def T32_Init(self):
+        self._call("T32_Init")
+        self.connected = True
+
+    def T32_Attach(self, device=None):
+        # pylint: disable=unused-argument
+        self._call("T32_Attach")
+
+    def T32_Exit(self):
+        self._call("T32_Exit")
+
+        for area in list(self.areas):
+            self._close_area(area)
+
+        self.connected = False
+
+    def T32_Terminate(self, exit_code=0):
+        # pylint: disable=unused-argument
+        self._call("T32_Terminate")
+        self.T32_Exit()
+
+    def T32_Nop(self):
+        self._call("T32_Nop")
+        return True
+
+    def T32_Ping(self):
+        self._call("T32_Ping")
+        return True
+
+    def T32_Cmd(self, command):
+        self._call("T32_Cmd")
+        self._target_changed()
+        self._execute(command)
+
+    def T32_ExecuteCommand(self, cmd):
+        self._call("T32_ExecuteCommand")
+        self._target_changed()
+        self._execute(cmd)
+        return ""
+
+    def T32_ExecuteFunction(self, expression):
+        self._call("T32_ExecuteFunction")
+        value, restype = self._evaluate(expression)
+
+        if restype == ResultType.Boolean:
+            msg = "TRUE()" if value else "FALSE()"
+        elif restype == ResultType.Decimal:
+            msg = f"{value}."
+        else:
+            msg = f"0x{value:X}"
+
+        return {"msg": msg, "type": restype}
+
+    def T32_GetMessageString(self):
+        self._call("T32_GetMessageString")
+        msg, msg_type = self.message
+
+        if msg_type == MessageType.Ignore:
+            return {"msg": "", "types": (MessageType.Ignore,)}
+
+        return {"msg": msg, "types": (msg_type,)}
+
+    def T32_EvalGet(self):
+        self._call("T32_EvalGet")
+        return self.eval_result
+
+    def T32_EvalGetString(self):
+        self._call("T32_EvalGetString")
+        return ""
+
+    def T32_GetPracticeState(self):
+        self._call("T32_GetPracticeState")
+        return PracticeState.Idle
+
+    def T32_Stop(self):
+        self._call("T32_Stop")
+
+    def T32_ResetCPU(self):
+        self._call("T32_ResetCPU")
+        self._target_changed()
+
+    def T32_Break(self):
+        self._call("T32_Break")
+        self._target_changed()
+
+    # ----------------------------------------------------------------------- #
+
+    def T32_RequestBufferObj(self, size=0):
+        self._call("T32_RequestBufferObj")
+        return bytearray(size)
+
+    def T32_ReleaseBufferObj(self, handle):
+        # pylint: disable=unused-argument
+        self._call("T32_ReleaseBufferObj")
+
+    def T32_CopyDataFromBufferObj(self, handle, size, offset=0):
+        self._call("T32_CopyDataFromBufferObj")
+        return bytes(handle[offset:offset + size])
+
+    def T32_CopyDataToBufferObj(self, handle, data, offset=0):
+        self._call("T32_CopyDataToBufferObj")
+        handle[offset:offset + len(data)] = data
+
+    def T32_RequestAddressObjA32(self, address):
+        self._call("T32_RequestAddressObjA32")
+        return address
+
+    def T32_RequestAddressObjA64(self, address):
+        self._call("T32_RequestAddressObjA64")
+        return address
+
+    def T32_ReleaseAddressObj(self, handle):
+        # pylint: disable=unused-argument
+        self._call("T32_ReleaseAddressObj")
+
+    def _memory_obj(self, function):
+        """ Runs a memory-object access now, or queues it for the active
+        bundle. """
+
+        if self._bundle is None:
+            function()
+        else:
+            self._bundle.append(function)
+
+    def T32_ReadMemoryObj(self, buffer_handle, address_handle, length):
+        self._call("T32_ReadMemoryObj", length)
+
+        def read():
+            buffer_handle[:length] = self.target.read(address_handle, length)
+
+        self._memory_obj(read)
+
+    def T32_WriteMemoryObj(self, buffer_handle, address_handle, length):
+        self._call("T32_WriteMemoryObj", length)
+
+        def write():
+            self.target.write(address_handle, buffer_handle[:length])
+
+        self._memory_obj(write)
+
+    def T32_BundledAccessAlloc(self):
+        self._call("T32_BundledAccessAlloc")
+        self._bundle = []
+        return self._bundle
+
+    def T32_BundledAccessExecute(self, handle):
+        self._call("T32_BundledAccessExecute")
+        self._bundle = None
+
+        for function in handle:
+            function()
+
+    def T32_BundledAccessFree(self, handle):
+        # pylint: disable=unused-argument
+        self._call("T32_BundledAccessFree")
+        self._bundle = None
+
+    # ----------------------------------------------------------------------- #
+
+    def read_memory(self, address, address_width, length):
+        # pylint: disable=unused-argument
+        self._call("read_memory", length)
+        return self.target.read(address, length)
+
+    def read_memory_into(self, address, address_width, buffer):
+        # pylint: disable=unused-argument
+        view = memoryview(buffer).cast('B')
+        self._call("read_memory", view.nbytes)
+        view[:] = self.target.read(address, view.nbytes)
+        return view.nbytes
+
+    def write_memory(self, address, address_width, data):
+        # pylint: disable=unused-argument
+        self._call("write_memory", len(data))
+        self.target.write(address, data)
+
+    def read_memory_many(self, requests):
+        return [self.read_memory(x, None, y) for x, y in requests]
+
+    def write_memory_many(self, blocks):
+        for address, data in blocks:
+            self.write_memory(address, None, data)
@@ -0,0 +1,297 @@
+#!/usr/bin/env python3
+""" Provides a pool of TRACE32 instances that are launched and connected ahead
+of time, so that jobs don't have to wait for TRACE32 to start up. Instances
+are reset and recycled after each job. This is a library feature: the CLI
+runs one job per invocation, so it doesn't use a pool. """
+
+import collections
+import contextlib
+import queue
+import threading
+import time
+
+from .t32run import Trace32Subprocess, Podbus
+from .t32iface import Trace32Interface
+from .t32api import Trace32API
+
+# --------------------------------------------------------------------------- #
+
+_Member = collections.namedtuple("_Member", ["proc", "iface", "serial"])
+
+
+class Trace32Pool:
+    """ Keeps a number of TRACE32 instances launched and connected in the
+    background, and hands out a ready Trace32Interface for each job. When a
+    job releases its interface, the instance is reset (see
+    Trace32Interface.reset()) and returned to the pool. Instances that fail to
+    reset are shut down and replaced.
+
+    Simulator pools are sized with 'size'. For probe-bound pools, pass a list
+    of probe serials instead, and one instance is kept per probe. Interfaces
+    in a pool share this process, so the CAPI library must support
+    channels if there's more than one instance (start() checks this).
+
+    This class can be used as a 'with' context-manager, which starts the pool
+    and shuts it down afterwards. """
+
+    # pylint: disable=too-many-instance-attributes,too-many-arguments
+
+    def __init__(self, t32bin, size=2, podbus=Podbus.SIM, serials=None,
+                 libfile=None, system_down=True, log=None):
+
+        if serials:
+            podbus = Podbus.USB
+            size = len(serials)
+        else:
+            serials = [None] * size
+
+        self.t32bin = t32bin
+        self.size = size
+        self.podbus = podbus
+        self.serials = list(serials)
+        self.libfile = libfile
+        self.system_down = system_down
+        self.log = log
+
+        self._ready = queue.Queue()
+        self._leased = {}
+        self._members = []
+        self._lock = threading.Lock()
+        self._closed = False
+        self._threads = []
+
+        self._stats = {
+            'hits': 0,
+            'misses': 0,
+            'launches': 0,
+            'launch_failures': 0,
+            'launch_time': 0.0,
+            'resets': 0,
+            'reset_failures': 0,
+            'reset_time': 0.0,
+            'reset_time_max': 0.0,
+        }
+
+    def __enter__(self):
+        self.start()
+        return self
+
+    def __exit__(self, exception_type, exception_val, trace):
+        self.close()
+
+    def _log(self, message, level=2):
+        if self.log:
+            self.log(message, level=level)
+
+    def _background(self, function, *args):
+        """ Runs function(*args) in a daemon thread. """
+
+        thread = threading.Thread(target=function, args=args, daemon=True)
+        thread.start()
+
+        with self._lock:
+            self._threads = [x for x in self._threads if x.is_alive()]
+            self._threads.append(thread)
+
+    def _count(self, key, value=1):
+        with self._lock:
+            self._stats[key] += value
+
+    def start(self):
+        """ Starts launching every instance in the pool in the background.
+        Returns without waiting for them to become ready. Raises a
+        RuntimeError if the pool has more than one instance and the CAPI
+        library doesn't support channels, since every interface would then
+        talk to whichever TRACE32 connected last. """
+
+        if self.size > 1 and Trace32API(self.libfile).channel is None:
+            msg = f"A pool of {self.size} instances needs a CAPI library "
+            msg += "that supports channels (T32_SetChannel)."
+            raise RuntimeError(msg)
+
+        for serial in self.serials:
+            self._background(self._launch, serial)
+
+    def _launch(self, serial):
+        """ Launches and connects a single instance, and adds it to the ready
+        queue. Failures are added to the queue as well, so that they're
+        reported by acquire(). """
+
+        start = time.monotonic()
+        proc = None
+
+        try:
+            proc = Trace32Subprocess(self.t32bin, podbus=self.podbus,
+                                     libfile=self.libfile, serial=serial)
+            proc.start()
+            iface = Trace32Interface(libfile=self.libfile, port=proc.port,
+                                     tempdir=proc.tempdir, sequenced=True)
+            iface.__enter__()
+
+        # pylint: disable=broad-except
+        except Exception as err:
+            self._count('launch_failures')
+            self._log(f"Pool: launch failed ({err}).", level=1)
+
+            if proc is not None:
+                proc.stop(0.25)
+
+            self._ready.put((serial, err))
+            return
+
+        member = _Member(proc, iface, serial)
+        elapsed = time.monotonic() - start
+
+        with self._lock:
+            self._stats['launches'] += 1
+            self._stats['launch_time'] += elapsed
+            self._members.append(member)
+            closed = self._closed
+
+        if closed:
+            self._shutdown(member)
+            return
+
+        self._log(f"Pool: instance on port {proc.port} ready "
+                  f"({elapsed:.2f} sec).")
+        self._ready.put((member, None))
+
+    def _shutdown(self, member):
+        """ Disconnects from an instance, and shuts its TRACE32 down. """
+
+        with self._lock:
+            if member in self._members:
+                self._members.remove(member)
+
+        try:
+            member.iface.disconnect()
+        # pylint: disable=broad-except
+        except Exception:
+            pass
+
+        member.proc.__exit__(None, None, None)
+
+    def acquire(self, timeout=None):
+        """ Returns a ready Trace32Interface from the pool. Waits for up to
+        'timeout' seconds (or forever) if none are ready yet. Raises
+        TimeoutError if nothing became ready in time, or re-raises the error
+        from a failed launch (which is retried in the background). """
+
+        if self._closed:
+            raise RuntimeError("Pool is closed")
+
+        try:
+            member, err = self._ready.get_nowait()
+            waited = False
+        except queue.Empty:
+            waited = True
+
+            try:
+                member, err = self._ready.get(timeout=timeout)
+            except queue.Empty:
+                self._count('misses')
+                raise TimeoutError("No pooled TRACE32 became ready") from None
+
+        if err is not None:
+            self._background(self._launch, member)
+            raise err
+
+        self._count('misses' if waited else 'hits')
+
+        with self._lock:
+            self._leased[id(member.iface)] = member
+
+        return member.iface
+
+    def release(self, iface, discard=False):
+        """ Returns an interface to the pool. The instance is reset in the
+        background, and becomes available again once the reset is complete.
+        If 'discard' is set, the instance is shut down and replaced
+        instead. """
+
+        with self._lock:
+            member = self._leased.pop(id(iface))
+
+        self._background(self._recycle, member, discard)
+
+    def _recycle(self, member, discard=False):
+        """ Resets an instance and puts it back in the ready queue. Replaces it
+        with a new instance if it can't be reset. """
+
+        if not discard and not self._closed:
+            start = time.monotonic()
+
+            try:
+                member.iface.reset(system_down=self.system_down)
+                elapsed = time.monotonic() - start
+
+                with self._lock:
+                    self._stats['resets'] += 1
+                    self._stats['reset_time'] += elapsed
+                    self._stats['reset_time_max'] = max(
+                        elapsed, self._stats['reset_time_max'])
+
+                self._ready.put((member, None))
+                return
+
+            # pylint: disable=broad-except
+            except Exception as err:
+                self._count('reset_failures')
+                self._log(f"Pool: reset failed ({err}), replacing instance.",
+                          level=1)
+
+        self._shutdown(member)
+
+        if not self._closed:
+            self._launch(member.serial)
+
+    @contextlib.contextmanager
+    def lease(self, timeout=None):
+        """ Context-manager that acquires an interface, and releases it when
+        the context exits. """
+
+        iface = self.acquire(timeout)
+
+        try:
+            yield iface
+        finally:
+            self.release(iface)
+
+    def stats(self):
+        """ Returns a dict of pool metrics: hit/miss counts for acquire(), the
+        number of launches and resets (and failures of each), and the average
+        and maximum reset times in seconds. """
+
+        with self._lock:
+            stats = dict(self._stats)
+            stats['ready'] = self._ready.qsize()
+            stats['leased'] = len(self._leased)
+
+        stats['launch_time_avg'] = stats['launch_time'] / max(
+            stats['launches'], 1)
+        stats['reset_time_avg'] = stats['reset_time'] / max(stats['resets'], 1)
+        return stats
+
+    def close(self):
+        """ Shuts down every instance in the pool, including leased ones. """
+
+        with self._lock:
+            self._closed = True
+            threads = list(self._threads)
+
+        for thread in threads:
+            thread.join()
+
+        with self._lock:
+            members = list(self._members)
+
+        for member in members:
+            self._shutdown(member)
+
+        self._leased.clear()
+
+        while True:
+            try:
+                self._ready.get_nowait()
+            except queue.Empty:
+                break
@@ -266,12 +266,15 @@ class Trace32Subprocess:
     """ Class for running Trace32 in a subprocess, and communicating with its
     stdin/stdout/stderr via queues. This class can be used as a 'with'
     context-manager if you want it to attempt an API-based request for Trace32
-    to quite gracefully. """
+    to quite gracefully.
+
+    If more than one USB debugger is connected, 'serial' selects the one to use
+    by its serial number (or nodename). """
 
     # pylint: disable=too-many-instance-attributes
 
     def __init__(self, trace32_bin, podbus: Podbus = Podbus.SIM, gui=False,
-                 libfile=None):
+                 libfile=None, serial=None):
         self.port, self._dummy_socket = self._get_port()
         self.t32dir = find_trace32_dir(trace32_bin)
         self.t32bin = find_trace32_bin(trace32_bin, self.t32dir)
@@ -283,6 +286,7 @@ class Trace32Subprocess:
         self.popen = None
         self.podbus = podbus
         self.libfile = libfile
+        self.serial = serial
 
         with open(self.config_file, "w") as outfile:
             outfile.write(self._genconfig(gui, podbus))
@@ -385,11 +389,13 @@ class Trace32Subprocess:
             """
 
         if podbus == Podbus.USB:
-            config += """
-            PBI=
-            USB
-            CONNECTIONMODE=AUTOCONNECT
-            """
+            pbi = ["PBI=", "USB"]
+
+            if self.serial:
+                pbi.append(f"NODE={self.serial}")
+
+            pbi.append("CONNECTIONMODE=AUTOCONNECT")
+            config += "\n" + "\n".join(pbi) + "\n"
         else:
             config += """
             PBI=SIM
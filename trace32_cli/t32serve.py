@@ -0,0 +1,264 @@
+#!/usr/bin/env python3
+""" Provides a server that keeps one Trace32Interface connected in the
+background, and a client that lets other processes reuse it over a Unix
+socket. This avoids paying for TRACE32's startup and connection setup on
+every CLI invocation. """
+
+import getpass
+import io
+import os
+from multiprocessing.connection import Listener, Client
+
+# --------------------------------------------------------------------------- #
+
+
+def default_socket_path():
+    """ Returns the default socket path for a server. The socket is placed
+    in $XDG_RUNTIME_DIR, $TMPDIR, $TMP, or $TEMP (in that order) if any of
+    those are set. Otherwise, /tmp is used. """
+
+    base = "/tmp"
+
+    for varname in ["XDG_RUNTIME_DIR", "TMPDIR", "TMP", "TEMP"]:
+        if varname in os.environ and os.path.isdir(os.environ[varname]):
+            base = os.environ.get(varname)
+            break
+
+    return os.path.join(base, f"trace32-cli-{getpass.getuser()}.sock")
+
+
+def find_server(address=None):
+    """ Connects to a running server at 'address', and returns a
+    Trace32Client for it. Returns None if no server is listening there. """
+
+    if address is None:
+        address = default_socket_path()
+
+    if not os.path.exists(address):
+        return None
+
+    try:
+        return Trace32Client(address)
+    except (ConnectionRefusedError, FileNotFoundError):
+        return None
+
+
+class Trace32Server:
+    """ Serves requests from Trace32Client instances, using a single
+    already-connected Trace32Interface. Clients are serviced one at a time,
+    in the order that they connect. """
+
+    methods = (
+        'ping', 'read_memory', 'write_memory', 'read_many', 'write_many',
+        'crc32', 'run_command', 'run_commands', 'run_file', 'eval_expression',
+        'eval_many'
+    )
+
+    def __init__(self, iface, address=None):
+        if address is None:
+            address = default_socket_path()
+
+        self.iface = iface
+        self.address = address
+        self.listener = None
+        self.running = False
+
+    def _handle(self, method, args, kwargs):
+        """ Runs a single request against the interface, and returns the
+        result. If the request asked for a log, returns a tuple of
+        (result, log_text) instead. """
+
+        if method == 'tempdir':
+            return self.iface.tempdir
+
+        if method == 'loopback':
+            return self.iface.loopback
+
+        if method == 'shutdown':
+            self.running = False
+            return None
+
+        if method not in self.methods:
+            raise ValueError(f"Unknown server request [{method}]")
+
+        if not kwargs.pop('logged', False):
+            return getattr(self.iface, method)(*args, **kwargs)
+
+        logfile = io.StringIO()
+        result = getattr(self.iface, method)(*args, logfile=logfile, **kwargs)
+        return (result, logfile.getvalue())
+
+    def _service(self, conn):
+        """ Services requests from a single client until it disconnects or
+        asks the server to shut down. Raises OSError or EOFError if the
+        connection to the client fails. """
+
+        while self.running:
+            try:
+                method, args, kwargs = conn.recv()
+            except EOFError:
+                break
+
+            try:
+                response = ('ok', self._handle(method, args, kwargs))
+            # pylint: disable=broad-except
+            except Exception as err:
+                response = ('error', err)
+
+            try:
+                conn.send(response)
+            except (OSError, EOFError):
+                raise
+            # pylint: disable=broad-except
+            except Exception:
+                conn.send(('error', RuntimeError(str(response[1]))))
+
+    def serve_forever(self, log=None):
+        """ Listens for clients until a client requests a shutdown, or until
+        a KeyboardInterrupt is received. """
+
+        client = find_server(self.address)
+        if client is not None:
+            client.close()
+            raise OSError(f"A server is already running at {self.address}")
+
+        if os.path.exists(self.address):
+            os.remove(self.address)
+
+        old_umask = os.umask(0o077)
+        try:
+            self.listener = Listener(self.address, family='AF_UNIX')
+        finally:
+            os.umask(old_umask)
+
+        if log:
+            log(f"Listening on [{self.address}].")
+
+        self.running = True
+
+        try:
+            while self.running:
+                with self.listener.accept() as conn:
+                    if log:
+                        log("Client connected.", level=2)
+
+                    try:
+                        self._service(conn)
+                    except (OSError, EOFError) as err:
+                        if log:
+                            log(f"Dropped client ({err}).", level=2)
+
+        except KeyboardInterrupt:
+            pass
+
+        finally:
+            self.running = False
+            self.listener.close()
+
+        if log:
+            log("Server shut down.", level=2)
+
+
+class Trace32Client:
+    """ Stand-in for Trace32Interface that forwards its calls to a running
+    Trace32Server. Supports the subset of Trace32Interface that's used by the
+    CLI. This class can be used as a 'with' context-manager for
+    auto-disconnect. """
+
+    def __init__(self, address):
+        self.address = address
+        self.conn = Client(address, family='AF_UNIX')
+        self.tempdir = self._call('tempdir')
+        self.loopback = self._call('loopback')
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exception_type, exception_val, trace):
+        self.close()
+
+    def close(self):
+        """ Disconnects from the server. The server keeps running. """
+        self.conn.close()
+
+    def _call(self, method, *args, **kwargs):
+        """ Sends a request to the server, and returns its result. Exceptions
+        raised by the server are re-raised here. """
+
+        self.conn.send((method, args, kwargs))
+        status, value = self.conn.recv()
+
+        if status == 'error':
+            raise value
+
+        return value
+
+    def _call_logged(self, method, logfile, *args, **kwargs):
+        """ Same as _call(), except that any log output generated on the
+        server is written to 'logfile'. """
+
+        if logfile is None:
+            return self._call(method, *args, **kwargs)
+
+        result, log_text = self._call(method, *args, logged=True, **kwargs)
+        logfile.write(log_text)
+        return result
+
+    def shutdown(self):
+        """ Asks the server to stop listening and exit. """
+        self._call('shutdown')
+
+    def ping(self):
+        """ Checks to make sure that the server's API is connected and
+        active. """
+        self._call('ping')
+
+    def read_memory(self, address, length, address_width=None):
+        """ See Trace32Interface.read_memory(). """
+        return self._call('read_memory', address, length, address_width)
+
+    def read_memory_into(self, address, buffer, address_width=None):
+        """ See Trace32Interface.read_memory_into(). """
+        view = memoryview(buffer).cast('B')
+        view[:] = self.read_memory(address, view.nbytes, address_width)
+        return view.nbytes
+
+    def write_memory(self, address, data, address_width=None):
+        """ See Trace32Interface.write_memory(). """
+        self._call('write_memory', address, bytes(data), address_width)
+
+    def read_many(self, requests):
+        """ See Trace32Interface.read_many(). """
+        return self._call('read_many', list(requests))
+
+    def write_many(self, blocks):
+        """ See Trace32Interface.write_many(). """
+        blocks = [(address, bytes(data)) for address, data in blocks]
+        self._call('write_many', blocks)
+
+    def crc32(self, address, length):
+        """ See Trace32Interface.crc32(). """
+        return self._call('crc32', address, length)
+
+    def run_file(self, scriptfile, args=(), logfile=None):
+        """ See Trace32Interface.run_file(). """
+        scriptfile = os.path.abspath(scriptfile)
+        return self._call_logged('run_file', logfile, scriptfile, args=args)
+
+    def run_command(self, cmd, logfile=None):
+        """ See Trace32Interface.run_command(). """
+        return self._call_logged('run_command', logfile, cmd)
+
+    def run_commands(self, cmds, logfile=None):
+        """ See Trace32Interface.run_commands(). """
+        return self._call_logged('run_commands', logfile, list(cmds))
+
+    def eval_expression(self, expression, decode=True, logfile=None):
+        """ See Trace32Interface.eval_expression(). """
+        return self._call_logged('eval_expression', logfile, expression,
+                                 decode=decode)
+
+    def eval_many(self, expressions, decode=True, logfile=None):
+        """ See Trace32Interface.eval_many(). """
+        return self._call_logged('eval_many', logfile, list(expressions),
+                                 decode=decode)
@@ -0,0 +1,198 @@
+#!/usr/bin/env python3
+""" Block-size auto-tuning for memory transfers. The best block size depends
+on the debug probe, the JTAG/SWD clock, and the API's PACKLEN, so it's
+measured on the fly. Tuned values are cached in a per-user profile file, so
+that later runs on the same setup can start from them. """
+
+import json
+import os
+import statistics
+import tempfile
+
+# --------------------------------------------------------------------------- #
+
+
+def profile_path():
+    """ Returns the path of the profile file. It's kept in $XDG_CACHE_HOME
+    (or ~/.cache) under 'trace32-cli'. """
+
+    cache_dir = os.environ.get("XDG_CACHE_HOME")
+    if not cache_dir:
+        cache_dir = os.path.join(os.path.expanduser("~"), ".cache")
+
+    return os.path.join(cache_dir, "trace32-cli", "profiles.json")
+
+
+def profile_key(t32bin, protocol, serial=None):
+    """ Returns the profile key for a TRACE32 binary, protocol, and probe. """
+
+    return f"{os.path.basename(t32bin)}/{protocol.lower()}/{serial or '-'}"
+
+
+def server_profile_key(address):
+    """ Returns the profile key for a TRACE32 server at 'address'. Servers get
+    their own keys, since the probe and PACKLEN behind them aren't known. """
+
+    return f"server:{address}"
+
+
+class Profile:
+    """ Tuned block sizes for one profile key and one transfer direction
+    ('read' or 'write'). Results are stored per PACKLEN, since that can only
+    be changed when connecting. A PACKLEN of None means TRACE32's default.
+
+    The profile file is a JSON object of the form:
+
+        {key: {direction: {packlen: {"blocksize": N, "rate": N}}}}
+
+    A missing or unreadable file is treated as empty. """
+
+    def __init__(self, key, direction, path=None):
+        self.key = key
+        self.direction = direction
+        self.path = path or profile_path()
+        self.entries = self._load().get(key, {}).get(direction, {})
+
+    def _load(self):
+        try:
+            with open(self.path, encoding="utf-8") as infile:
+                data = json.load(infile)
+        except (OSError, ValueError):
+            return {}
+
+        return data if isinstance(data, dict) else {}
+
+    @staticmethod
+    def _packlen_key(packlen):
+        return "default" if packlen is None else str(packlen)
+
+    def blocksize(self, packlen=None):
+        """ Returns the tuned block size for 'packlen', or None if there
+        isn't one. """
+
+        entry = self.entries.get(self._packlen_key(packlen), {})
+        return entry.get("blocksize")
+
+    def _fastest(self):
+        """ Returns the entry key ("default" or a PACKLEN string) with the
+        highest measured rate, or None if nothing was measured. """
+
+        if not self.entries:
+            return None
+
+        return max(self.entries, key=lambda x: self.entries[x]["rate"])
+
+    def best_packlen(self):
+        """ Returns the PACKLEN with the highest measured rate, or None if
+        nothing was measured or TRACE32's default PACKLEN was the fastest. """
+
+        best = self._fastest()
+
+        if best is None or best == "default":
+            return None
+
+        return int(best)
+
+    def faster_packlen(self, packlen, rate):
+        """ Returns a PACKLEN that measured faster than 'rate' in an earlier
+        run, "default" if TRACE32's default PACKLEN did, or None if neither
+        did. """
+
+        best = self._fastest()
+
+        if best is None or best == self._packlen_key(packlen):
+            return None
+
+        if self.entries[best]["rate"] <= rate:
+            return None
+
+        return best if best == "default" else int(best)
+
+    def update(self, packlen, blocksize, rate):
+        """ Records a tuned block size and its rate (in bytes/sec), and
+        writes the profile file. The file is replaced atomically, so
+        concurrent runs can't corrupt it. """
+
+        entry = {"blocksize": int(blocksize), "rate": float(rate)}
+        self.entries[self._packlen_key(packlen)] = entry
+
+        data = self._load()
+        data.setdefault(self.key, {})[self.direction] = self.entries
+        dirname = os.path.dirname(self.path)
+        os.makedirs(dirname, exist_ok=True)
+
+        with tempfile.NamedTemporaryFile("w", dir=dirname, suffix=".tmp",
+                                         delete=False) as outfile:
+            json.dump(data, outfile, indent=2, sort_keys=True)
+
+        os.replace(outfile.name, self.path)
+
+
+class BlockTuner:
+    """ Finds a good block size while a transfer is in progress. Callers ask
+    for 'size' before each block, and report how long each block took with
+    record(). Each size is measured 'samples' times.
+
+    The tuner starts at 'start' and keeps doubling the size while the
+    throughput improves by more than 'tolerance'. If doubling never helped,
+    it tries halving instead. Once neither direction helps, it settles on the
+    fastest size ('done' is set). Sizes stay within 'minimum' and 'maximum',
+    and are powers of two if 'start' is. """
+
+    # pylint: disable=too-many-arguments
+
+    def __init__(self, start, minimum=4096, maximum=4 * 2**20, samples=2,
+                 tolerance=0.05):
+
+        self.minimum = minimum
+        self.maximum = maximum
+        self.samples = samples
+        self.tolerance = tolerance
+        self.size = min(max(start, minimum), maximum)
+        self.rates = {}
+        self.best = None
+        self.growing = True
+        self.done = False
+
+    def record(self, size, elapsed):
+        """ Records a block of 'size' bytes that took 'elapsed' seconds to
+        transfer. Blocks that aren't the current size (like a short final
+        block) are ignored. """
+
+        if self.done or size != self.size or elapsed <= 0:
+            return
+
+        rates = self.rates.setdefault(size, [])
+        rates.append(size / elapsed)
+
+        if len(rates) < self.samples:
+            return
+
+        rate = statistics.median(rates)
+
+        if self.best is None or rate > self.best[1] * (1 + self.tolerance):
+            self.best = (size, rate)
+            self._advance(size * 2 if self.growing else size // 2)
+        else:
+            self._turn()
+
+    def _advance(self, size):
+        if self.minimum <= size <= self.maximum and size not in self.rates:
+            self.size = size
+        else:
+            self._turn()
+
+    def _turn(self):
+        """ Switches from growing to shrinking if the starting size was never
+        beaten, or else settles on the best size. """
+
+        smaller = self.best[0] // 2
+
+        if self.growing and smaller >= self.minimum and \
+                smaller not in self.rates:
+            self.growing = False
+            self.size = smaller
+            return
+
+        self.size = self.best[0]
+        self.done = True
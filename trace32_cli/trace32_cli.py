@@ -8,117 +8,430 @@ import re
 import os
 import io
 import time
+import signal
+import stat
+import hashlib
+import json
+import queue
+import threading
+import zlib
+from concurrent.futures import ThreadPoolExecutor
 
 from .t32run import usb_reset, Trace32Subprocess
 from .t32run import find_trace32_dir, find_trace32_bin, Podbus
 
 from .t32iface import Trace32Interface
+from .common import register_handler, make_tempdir
+from .t32serve import Trace32Server, find_server, default_socket_path
+from .t32fanout import load_targets, fan_out, format_results, spool
+from .t32gdb import GdbServer
+from .t32tune import BlockTuner, Profile, profile_key, server_profile_key
+from .t32bench import run_benchmarks, format_summary
+from .t32loopback import is_loopback
 
 # --------------------------------------------------------------------------- #
 
 
 def read(args, iface: Trace32Interface):
     """ Routine for reading data from the target's memory, and writing to
-    stdout or to an outfile. """
+    stdout or to an outfile. Blocks are read from the target in a background
+    thread, so that the next read is in flight while the previous block is
+    being written out.
 
-    outfile = None
-    received = 0
+    In 'crc' check mode, a CRC32 of each block is also computed on the target.
+    It's compared against the data that was received, and against the
+    reference file (if there is one). With --verify-only, no data is read at
+    all, and only the CRCs are compared. """
+    # pylint: disable=too-many-locals,too-many-branches,too-many-statements
 
     if args.reference:
         length = os.path.getsize(args.reference)
     else:
         length = args.count
 
-    while received < length:
-        chunksize = min(args.blocksize, length - received)
-        block = iface.read_memory(args.address + received, chunksize)
-        assert len(block) == chunksize
+    tuner = _start_tuning(args)
 
-        if outfile is None:
-            if args.outfile is None:
-                outfile = sys.stdout.buffer
+    if args.verify_only:
+        return _verify_reference(args, iface, length)
+
+    # Blocks are read into a ring of reusable buffers. The ring has room for
+    # every block that can be queued (prefetch() always queues at least one),
+    # plus the one being filled and the one being written out.
+
+    bufsize = tuner.maximum if tuner else args.blocksize
+    depth = max(args.queue_depth, 1)
+    ring = [bytearray(bufsize) for _ in range(depth + 2)]
+
+    def fetch():
+        received = 0
+        index = 0
+        while received < length:
+            size = tuner.size if tuner else args.blocksize
+            chunksize = min(size, length - received)
+            block = memoryview(ring[index])[:chunksize]
+            address = args.address + received
+            read_start = time.monotonic()
+            iface.read_memory_into(address, block)
+
+            if tuner:
+                tuner.record(chunksize, time.monotonic() - read_start)
+
+            if args.check == "crc":
+                yield address, block, iface.crc32(address, chunksize)
             else:
-                # pylint: disable=consider-using-with
-                outfile = open(args.outfile, 'wb')
+                yield address, block, None
+
+            received += chunksize
+            index = (index + 1) % len(ring)
+
+    if args.outfile is None:
+        outfile = sys.stdout.buffer
+    else:
+        # pylint: disable=consider-using-with
+        outfile = open(args.outfile, 'wb')
+
+    hasher = hashlib.new(args.hash) if args.hash else None
+    reference = _open_reference(args)
+    mismatches = []
+    start = time.monotonic()
+
+    try:
+        for address, block, target_crc in prefetch(fetch(), args.queue_depth):
+            outfile.write(block)
+
+            if hasher:
+                hasher.update(block)
+
+            if target_crc is None:
+                continue
+
+            if zlib.crc32(block) != target_crc:
+                msg = f"CRC mismatch in {len(block)} bytes read from "
+                msg += f"{hex(address)} (transfer error)."
+                raise IOError(msg)
+
+            if reference and zlib.crc32(reference.read(len(block))) != \
+                    target_crc:
+                mismatches.append((address, len(block)))
+    finally:
+        if args.outfile is not None:
+            outfile.close()
+
+        if reference:
+            reference.close()
+
+    elapsed = time.monotonic() - start
+    rate = length / max(elapsed, 1e-9) / 1e6
+    args.log(f"Read {length} bytes in {elapsed:.2f} sec ({rate:.2f} MB/s).")
+    _finish_tuning(args, tuner)
 
-        outfile.write(block)
-        received += chunksize
+    if hasher:
+        args.log(f"{args.hash}: {hasher.hexdigest()}", level=0)
 
-    if args.outfile is not None:
-        outfile.close()
+    if args.check == "crc":
+        _report_mismatches(args, mismatches, length)
 
 
-def _write_api(args, iface: Trace32Interface):
-    """ Write data to memory using C-API calls. Knows 'none' and 'full'
-    modes. """
+def _open_reference(args):
+    """ Opens the reference file for CRC checking, if one is needed. """
 
+    if args.check == "crc" and args.reference:
+        return open(args.reference, "rb")
+
+    return None
+
+
+def _verify_reference(args, iface, length):
+    """ Compares target memory against the reference file, block-by-block,
+    using a CRC32 that's computed on the target. No data is read back. The
+    reference CRCs are computed in a background thread while the target is
+    computing its own. """
+
+    def host_crcs():
+        with open(args.reference, "rb") as reference:
+            while True:
+                block = reference.read(args.blocksize)
+                if not block:
+                    return
+                yield zlib.crc32(block), len(block)
+
+    mismatches = []
     address = args.address
+    start = time.monotonic()
 
-    while True:
-        block = args.infile.read(args.blocksize)
+    for crc, chunksize in prefetch(host_crcs(), args.queue_depth):
+        if iface.crc32(address, chunksize) != crc:
+            mismatches.append((address, chunksize))
+
+        address += chunksize
+
+    elapsed = time.monotonic() - start
+    args.log(f"Verified {length} bytes in {elapsed:.2f} sec.")
+    _report_mismatches(args, mismatches, length)
+
+
+def _report_mismatches(args, mismatches, length):
+    """ Logs each block that didn't match the reference, and raises an error
+    if there were any. """
 
-        if not block:
-            return True
+    if not mismatches:
+        args.log(f"CRC32 check of {length} bytes passed.", level=1)
+        return
 
-        args.log(f"Writing {len(block)} bytes to {hex(address)}", level=3)
-        iface.write_memory(address, block)
+    for address, size in mismatches:
+        args.log(f"Mismatch: {size} bytes at {hex(address)}.", level=0)
 
-        if args.check == "full":
-            msg = f"Verifying {len(block)} bytes at {hex(address)}"
-            args.log(msg, level=3)
-            readback = iface.read_memory(address, len(block))
-            assert readback == block
+    total = sum(x[1] for x in mismatches)
+    msg = f"{len(mismatches)} blocks ({total} bytes) don't match the "
+    msg += "reference."
+    raise IOError(msg)
+
+
+def _write_api(args, iface: Trace32Interface, tuner=None):
+    """ Write data to memory using C-API calls. Knows 'none', 'full', and
+    'crc' modes. In 'crc' mode, each block's CRC32 is computed on the target
+    after it's written, and compared against a host-side CRC32 (computed in a
+    worker thread). In delta mode, the same comparison is made before writing,
+    and blocks that already match are skipped. If a BlockTuner is given, it
+    picks the block size, based on how long each write takes. """
+    # pylint: disable=too-many-locals
+
+    address = args.address
+    total = written = 0
+    write_time = 0.0
+    start = time.monotonic()
 
-        address += len(block)
+    def blocks(pool):
+        while True:
+            block = args.infile.read(tuner.size if tuner else args.blocksize)
+
+            if not block:
+                return
+
+            if args.delta or args.check == "crc":
+                yield block, pool.submit(zlib.crc32, block)
+            else:
+                yield block, None
+
+    with ThreadPoolExecutor(max_workers=2) as pool:
+        for block, crc in prefetch(blocks(pool)):
+            total += len(block)
+
+            if args.delta:
+                if iface.crc32(address, len(block)) == crc.result():
+                    msg = f"Skipping {len(block)} bytes at {hex(address)}"
+                    args.log(msg, level=3)
+                    address += len(block)
+                    continue
+
+            args.log(f"Writing {len(block)} bytes to {hex(address)}",
+                     level=3)
+            block_start = time.monotonic()
+            iface.write_memory(address, block)
+
+            if tuner:
+                tuner.record(len(block), time.monotonic() - block_start)
+
+            if args.check == "full":
+                msg = f"Verifying {len(block)} bytes at {hex(address)}"
+                args.log(msg, level=3)
+                readback = iface.read_memory(address, len(block))
+                assert readback == block
+
+            elif args.check == "crc":
+                msg = f"Checking CRC of {len(block)} bytes at {hex(address)}"
+                args.log(msg, level=3)
+                target_crc = iface.crc32(address, len(block))
+
+                if target_crc != crc.result():
+                    msg = f"CRC mismatch after writing {len(block)} bytes to "
+                    msg += f"{hex(address)} (target: 0x{target_crc:08X}, "
+                    msg += f"expected: 0x{crc.result():08X})."
+                    raise IOError(msg)
+
+            write_time += time.monotonic() - block_start
+            written += len(block)
+            address += len(block)
+
+    if args.delta:
+        _log_delta(args, total, written, write_time,
+                   time.monotonic() - start)
+
+    _finish_tuning(args, tuner)
+    return True
+
+
+def _log_delta(args, total, written, write_time, elapsed):
+    """ Reports how much of a delta-mode write was skipped, and estimates the
+    speedup over writing everything (based on the measured write rate). """
+
+    skipped = total - written
+    percent = 100 * skipped / max(total, 1)
+    args.log(f"Skipped {skipped} of {total} bytes already on target "
+             f"({percent:.1f}%).")
+
+    if written:
+        full_time = write_time * total / written
+        speedup = full_time / max(elapsed, 1e-9)
+        args.log(f"Estimated speedup over a full write: {speedup:.2f}x "
+                 f"({elapsed:.2f} sec instead of ~{full_time:.2f} sec).")
 
 
 def _write_practice(args, iface: Trace32Interface):
     """ Write data to memory using PRACTICE DATA.LOAD.BINARY commands. Knows
-    how to use "sparse" and "checksum" modes. """
+    how to use "sparse" and "checksum" modes.
+
+    Seekable files are loaded directly, in chunks that grow until each load
+    takes about args.load_time seconds. Non-seekable input (like stdin) is
+    split into a ring of block files in the tempdir. The ring is filled in a
+    background thread, so that the next block is being received while
+    TRACE32 loads the current one. """
+    # pylint: disable=too-many-locals
 
     address = args.address
     logfile = args.logdest if (args.verbosity >= 3) else None
     base_command = 'Data.LOAD.Binary @filename @start++@size'
+    ring = []
+    total = None
     completed = 0
+    start = time.monotonic()
 
     if args.infile.seekable() and os.path.isfile(args.infile.name):
-        buffer_file = None
-        base_command = base_command.replace("@filename", args.infile.name)
         base_command += " /SKIP @skip"
         total = args.infile.seek(0, io.SEEK_END)
+        loads = _file_loads(args.infile, args.blocksize, args.load_time)
     else:
-        buffer_file = os.path.join(iface.tempdir, "buffer.bin")
-        base_command = base_command.replace("@filename", buffer_file)
-        total = None
+        # Same sizing as the read() ring: prefetch() always queues at least
+        # one block, so a depth of 0 still needs three files.
+
+        depth = max(args.queue_depth, 1)
+        ring = [os.path.join(iface.tempdir, f"buffer{x}.bin")
+                for x in range(depth + 2)]
+        loads = prefetch(_stream_loads(args.infile, ring, args.blocksize),
+                         args.queue_depth)
 
     if args.check == "sparse":
         base_command += " /PVerify"
     else:
         base_command += f" /CHECKLOAD {hex(args.scratchpad)}++0xFFFF"
 
+    try:
+        for filename, skip, chunksize in loads:
+            if args.check == "checksum":
+                scratchpad_avoid(address, chunksize, args.scratchpad)
+
+            cmd = base_command.replace("@filename", filename)
+            cmd = cmd.replace("@start", hex(address))
+            cmd = cmd.replace("@size", hex(chunksize - 1))
+            cmd = cmd.replace("@skip", hex(skip))
+
+            args.log(f"Running [{cmd}]", level=3)
+            iface.run_command(cmd, logfile=logfile)
+            address += chunksize
+            completed += chunksize
+            _log_progress(args, completed, total, time.monotonic() - start)
+    finally:
+        for filename in ring:
+            if os.path.exists(filename):
+                os.remove(filename)
+
+
+def _log_progress(args, completed, total, elapsed):
+    """ Logs the progress of a write. 'total' is None if it's unknown. """
+
+    rate = completed / max(elapsed, 1e-9) / 1e6
+    msg = f"Wrote {completed}"
+
+    if total:
+        msg += f" of {total} bytes ({100 * completed / total:.1f}%"
+    else:
+        msg += " bytes ("
+
+    args.log(msg + f", {rate:.2f} MB/s).", level=2)
+
+
+def _file_loads(infile, blocksize, load_time=None):
+    """ Splits a seekable input file into loads, and yields a (filename,
+    offset, size) tuple for each one. Loads start out at 'blocksize' bytes.
+
+    If 'load_time' is set, the chunk size adapts so that each load takes
+    about 'load_time' seconds, which spreads the per-command overhead over as
+    much data as possible while still reporting progress regularly. The time
+    between requests for the next load is taken as the time that the previous
+    load took. A chunk can grow by at most 4x per load. """
+
+    total = infile.seek(0, io.SEEK_END)
+    completed = 0
+    chunksize = blocksize
+
+    while completed < total:
+        chunksize = min(total - completed, chunksize)
+        start = time.monotonic()
+        yield infile.name, completed, chunksize
+        elapsed = time.monotonic() - start
+        completed += chunksize
+
+        if load_time:
+            rate = chunksize / max(elapsed, 1e-6)
+            target = int(rate * load_time) // 4096 * 4096
+            chunksize = max(blocksize, min(target, chunksize * 4))
+
+
+def _stream_loads(infile, ring, blocksize):
+    """ Splits a non-seekable input stream into blocks of up to 'blocksize'
+    bytes, storing each one in the next file of 'ring'. Yields a (filename, 0,
+    size) tuple for each one. The caller must be done with a file before the
+    generator comes back around to it. """
+
+    index = 0
+
     while True:
-        if buffer_file:
-            block = args.infile.read(args.blocksize)
-            with open(buffer_file, "wb") as outfile:
-                outfile.write(block)
-            chunksize = len(block)
-        else:
-            chunksize = min(total - completed, args.blocksize)
+        chunksize = _fill_file(infile, ring[index], blocksize)
 
         if chunksize == 0:
             return
 
-        if args.check == "checksum":
-            scratchpad_avoid(address, chunksize, args.scratchpad)
+        yield ring[index], 0, chunksize
+        index = (index + 1) % len(ring)
 
-        cmd = base_command.replace("@start", hex(address))
-        cmd = cmd.replace("@size", hex(chunksize - 1))
-        cmd = cmd.replace("@skip", hex(completed))
 
-        args.log(f"Running [{cmd}]", level=3)
-        iface.run_command(cmd, logfile=logfile)
-        completed += chunksize
-        address += chunksize
+def _fill_file(infile, filename, size):
+    """ Copies up to 'size' bytes from 'infile' into a new file, and returns
+    the number of bytes copied. If the input is a pipe, os.splice() is used so
+    that the data is moved by the kernel instead of being copied through
+    Python. """
+
+    with open(filename, "wb") as outfile:
+        if not _spliceable(infile):
+            block = infile.read(size)
+            outfile.write(block)
+            return len(block)
+
+        copied = 0
+
+        while copied < size:
+            count = os.splice(infile.fileno(), outfile.fileno(), size - copied)
+
+            if count == 0:
+                break
+
+            copied += count
+
+        return copied
+
+
+def _spliceable(infile):
+    """ Checks whether os.splice() can be used for reading from 'infile'.
+    This requires a pipe. Splicing bypasses the file object's read buffer, so
+    the input must not have been read from before the write starts. """
+
+    if not hasattr(os, "splice"):
+        return False
+
+    try:
+        return stat.S_ISFIFO(os.fstat(infile.fileno()).st_mode)
+    except (AttributeError, OSError, io.UnsupportedOperation):
+        return False
 
 
 def write(args, iface: Trace32Interface):
@@ -134,8 +447,10 @@ def write(args, iface: Trace32Interface):
     msg = f"Writing to {hex(address)} with a verify-mode of [{args.check}]."
     args.log(msg, level=1)
 
-    if args.check in ("none", "full"):
-        return _write_api(args, iface)
+    tuner = _start_tuning(args)
+
+    if args.check in ("none", "full", "crc"):
+        return _write_api(args, iface, tuner)
 
     if args.check in ("sparse", "checksum"):
         return _write_practice(args, iface)
@@ -146,7 +461,11 @@ def write(args, iface: Trace32Interface):
 def run(args, iface: Trace32Interface):
     """ Routine for running a PRACTICE/TRACE32 command or script. """
 
-    if args.command:
+    if args.batch is not None:
+        args.log(f"Running {len(args.batch)} commands from stdin", level=2)
+        iface.run_commands(args.batch, logfile=args.logdest)
+
+    elif args.command:
         cmd = ' '.join(args.statement)
         args.log(f"Running command [{cmd}]", level=2)
         iface.run_command(cmd, logfile=args.logdest)
@@ -157,9 +476,170 @@ def run(args, iface: Trace32Interface):
                  level=2)
         iface.run_file(script, args.statement[1:], logfile=args.logdest)
 
+
+def serve(args, iface: Trace32Interface):
+    """ Routine for serving the connected TRACE32 instance to other CLI
+    invocations until a client asks the server to stop. """
+
+    def interrupt():
+        raise KeyboardInterrupt()
+
+    register_handler(signal.SIGTERM, interrupt)
+    server = Trace32Server(iface, args.socket)
+    server.serve_forever(log=args.log)
+
+
+def gdb(args, iface: Trace32Interface):
+    """ Routine for serving the connected TRACE32 instance to GDB over the
+    remote-serial protocol, until interrupted. """
+
+    def interrupt():
+        raise KeyboardInterrupt()
+
+    register_handler(signal.SIGTERM, interrupt)
+    server = GdbServer(iface, args.listen, log=args.log,
+                       page_size=args.page_size)
+    server.serve_forever()
+
+
+def bench(args, iface: Trace32Interface):
+    """ Routine for benchmarking the connection to the target. Writes the
+    results as JSON to stdout or to an outfile, and logs a human-readable
+    summary. """
+
+    args.log("Running benchmarks.", level=1)
+    results = run_benchmarks(iface, args.address, sizes=args.sizes,
+                             count=args.count, total=args.total,
+                             read_only=args.read_only, log=args.log)
+
+    # The launch options only describe the link if this command launched
+    # TRACE32 itself. Otherwise, they're recorded as unknown (null).
+
+    server = not isinstance(iface, Trace32Interface)
+    loopback = iface.loopback
+    launched = not (server or loopback)
+
+    results['config'] = {
+        't32bin': args.t32bin if launched else None,
+        'protocol': args.protocol if launched else None,
+        'packlen': args.packlen if launched else None,
+        'server': server,
+        'loopback': loopback,
+        'address': args.address,
+        'time': time.strftime("%Y-%m-%dT%H:%M:%S%z"),
+    }
+
+    for line in format_summary(results):
+        args.log(line, level=0)
+
+    if args.outfile is None:
+        json.dump(results, sys.stdout, indent=2)
+        sys.stdout.write("\n")
+    else:
+        with open(args.outfile, "w", encoding="utf-8") as outfile:
+            json.dump(results, outfile, indent=2)
+            outfile.write("\n")
+
 # --------------------------------------------------------------------------- #
 
 
+def _start_tuning(args):
+    """ Resolves '--blocksize auto'. The block size starts at the value
+    from the tuning profile (or at 1M if there isn't one), and a BlockTuner
+    is returned to adjust it as the transfer runs. Returns None if the block
+    size was given explicitly. """
+
+    if args.blocksize != "auto":
+        return None
+
+    profile = getattr(args, 'profile', None)
+    start = profile.blocksize(args.packlen) if profile else None
+
+    if start:
+        args.log(f"Starting from tuned block size of {start} bytes.",
+                 level=2)
+
+    args.blocksize = start or 2**20
+    return BlockTuner(args.blocksize)
+
+
+def _finish_tuning(args, tuner):
+    """ Reports the block size that a BlockTuner settled on, and saves it
+    to the tuning profile. """
+
+    if tuner is None or tuner.best is None:
+        return
+
+    size, rate = tuner.best
+    state = "Tuned" if tuner.done else "Partially tuned"
+    args.log(f"{state} block size: {size} bytes ({rate / 1e6:.2f} MB/s).",
+             level=1)
+
+    profile = getattr(args, 'profile', None)
+    if profile is None:
+        return
+
+    faster = profile.faster_packlen(args.packlen, rate)
+    if faster == "default":
+        args.log("An earlier run was faster without --packlen.", level=1)
+    elif faster:
+        args.log(f"An earlier run was faster with --packlen {faster}.",
+                 level=1)
+
+    profile.update(args.packlen, size, rate)
+
+
+def prefetch(iterable, depth=2):
+    """ Runs 'iterable' in a background thread, keeping up to 'depth' of its
+    items queued ahead of the consumer, and yields them in order. Exceptions
+    raised by 'iterable' are re-raised in the consumer. The background thread
+    is stopped if the consumer stops early. """
+
+    items = queue.Queue(maxsize=max(depth, 1))
+    stop = threading.Event()
+    finished = object()
+
+    def put(item):
+        while not stop.is_set():
+            try:
+                items.put(item, timeout=0.1)
+                return True
+            except queue.Full:
+                pass
+
+        return False
+
+    def produce():
+        try:
+            for item in iterable:
+                if not put((item, None)):
+                    return
+        # pylint: disable=broad-except
+        except Exception as err:
+            put((finished, err))
+            return
+
+        put((finished, None))
+
+    thread = threading.Thread(target=produce, daemon=True)
+    thread.start()
+
+    try:
+        while True:
+            item, err = items.get()
+
+            if err is not None:
+                raise err
+
+            if item is finished:
+                break
+
+            yield item
+    finally:
+        stop.set()
+        thread.join()
+
+
 def scratchpad_avoid(start, length, scratchpad, scratchpad_size=64*1024):
     """ Checks to see if a scratchpad overlaps with the address range that
     spans from lower_bound to upper_bound. Throws an exception if it does.
@@ -250,9 +730,50 @@ def constant(input_string):
     return int(value) * mult
 
 
+def blocksize(input_string):
+    """ Evaluate a blocksize argument, which is either 'auto' or a numerical
+    constant. """
+
+    if input_string.strip().lower() == "auto":
+        return "auto"
+
+    return constant(input_string)
+
+
+def constant_list(input_string):
+    """ Evaluate a comma-separated list of numerical constants. """
+
+    return [constant(x) for x in input_string.split(",") if x.strip()]
+
+
+def listen_address(input_string):
+    """ Parse a [HOST]:PORT string into a (host, port) tuple. An empty host
+    listens on localhost only, and a host of '*' listens on all
+    interfaces. """
+
+    host, _, port = input_string.rpartition(':')
+
+    if not host:
+        host = "localhost"
+    elif host == "*":
+        host = ""
+
+    try:
+        port = int(port, 10)
+    except ValueError:
+        msg = f"[{input_string}] isn't a valid [HOST]:PORT address"
+        raise argparse.ArgumentTypeError(msg) from None
+
+    if not 0 <= port <= 65535:
+        msg = f"port [{port}] is out of range"
+        raise argparse.ArgumentTypeError(msg)
+
+    return (host, port)
+
+
 def trace32_binary(input_string):
     """ Confirms that 'input_string' can be traced to a valid Trace32
-    binary of the requested name. """
+    binary of the requested name. Raises an OSError otherwise. """
 
     value = input_string.strip()
 
@@ -261,8 +782,7 @@ def trace32_binary(input_string):
         find_trace32_bin(value, install_dir)
         return value
     except Exception as err:
-        sys.stderr.write(f"{str(err)}\n")
-        raise argparse.ArgumentError(None, str(err))
+        raise OSError(str(err)) from err
 
 
 def path_readable(filename):
@@ -386,8 +906,34 @@ def common_options(storage: dict, toplevel: bool = False):
                        [usb, sim] (default: usb).""")
 
     group.add_argument("-t", "--t32bin", metavar="TRACE32BIN",
-                       default="t32marm", type=trace32_binary, help="""Trace32
-                       binary to use. Controls the target architecture
+                       default="t32marm", help="""Trace32 binary to use.
+                       Controls the target architecture (default:
+                       %(default)s).""")
+
+    group.add_argument("-S", "--socket", metavar="PATH", help="""Socket used
+                       to find (or to create, for the 'serve' command) a
+                       TRACE32 server. Commands use a running server instead
+                       of launching TRACE32 when one is found (default:
+                       %s).""" % default_socket_path())
+
+    group.add_argument("-T", "--targets", metavar="FILE", type=path_readable,
+                       help="""TOML file that lists several targets to run
+                       'write' or 'run' on in parallel, with one TRACE32 per
+                       target. Each [[target]] table can set a name, a probe
+                       serial, a protocol, and a t32bin (default:
+                       %(default)s).""")
+
+    group.add_argument("--packlen", metavar="BYTES", type=constant,
+                       help="""PACKLEN to use for the API connection to
+                       TRACE32. With '--blocksize auto', the fastest PACKLEN
+                       from earlier runs is used if this isn't given
+                       (default: TRACE32's default).""")
+
+    group.add_argument("--libfile", metavar="PATH", help="""TRACE32 CAPI
+                       library to use instead of the bundled one. Use
+                       'loopback' to run against an in-memory fake target
+                       without launching TRACE32, optionally with simulated
+                       costs, like 'loopback:latency=1e-4,bandwidth=8e6'
                        (default: %(default)s).""")
 
     return parser
@@ -421,12 +967,38 @@ def create_parser():
                         start with a "0x" prefix.""", type=constant)
 
     parser.add_argument("-b", "--blocksize", help="""Maximum blocksize to use
-                        for read operations (default: %(default)s).""",
-                        default="1M", type=constant)
+                        for read operations. Use 'auto' to tune it from the
+                        measured throughput, starting from the value that was
+                        tuned for this target in an earlier run (default:
+                        %(default)s).""", default="1M", type=blocksize)
 
     parser.add_argument("-o", "--outfile", help="""Output file to write
                         (default: stdout).""", type=path_writeable)
 
+    parser.add_argument("-q", "--queue-depth", metavar="DEPTH", help="""Number
+                        of blocks to read ahead of the output file
+                        (default: %(default)s).""", default=2, type=int)
+
+    hash_modes = sorted(x for x in hashlib.algorithms_guaranteed
+                        if not x.startswith("shake"))
+    parser.add_argument("--hash", metavar="ALGORITHM", choices=hash_modes,
+                        help="""Hash the data as it's read, and print the
+                        digest when finished. Known algorithms are:
+                        [%(choices)s] (default: %(default)s).""")
+
+    parser.add_argument("--check", metavar="MODE", default="none",
+                        choices=("none", "crc"), help="""Checking mode for
+                        read data. In [crc] mode, a CRC32 of each block is
+                        computed on the target, and compared against the data
+                        received (and against FILE, if -r/--reference is
+                        used). Known modes are: [%(choices)s] (default:
+                        %(default)s).""")
+
+    parser.add_argument("--verify-only", action="store_true", help="""Don't
+                        read any data. Only compare the target's memory
+                        against -r/--reference, using --check=crc. Can't be
+                        used with -o/--outfile.""")
+
     group = parser.add_mutually_exclusive_group(required=True)
 
     group.add_argument("-r", "--reference", metavar="FILE", required=False,
@@ -444,11 +1016,13 @@ def create_parser():
                                    memory""", parents=child_common)
 
     parser.description = """ Write a file to the target's memory. Optionally
-    check the result of the write operation using one of three modes: full,
-    sparse, and checksum. In [full] verification mode, the write is fully
-    verified. In [sparse] verification mode, 1/16 of all writes are verified.
-    In [checksum] verification mode, Trace32 uploads a temporary program into
-    SPADDRESS and uses it to checksum the target region. """
+    check the result of the write operation using one of four modes: full,
+    crc, sparse, and checksum. In [full] verification mode, the write is fully
+    verified. In [crc] verification mode, a CRC32 of each block is computed
+    on the target and compared against the written data. In [sparse]
+    verification mode, 1/16 of all writes are verified. In [checksum]
+    verification mode, Trace32 uploads a temporary program into SPADDRESS and
+    uses it to checksum the target region. """
 
     parser.add_argument("address", metavar="ADDRESS", help="""Target address to
                         read from the target. Hexadecimal addresses should
@@ -458,7 +1032,7 @@ def create_parser():
                         file to write (default: stdin).""",
                         type=argparse.FileType('rb'), default=sys.stdin.buffer)
 
-    check_modes = ("full", "checksum", "sparse", "none")
+    check_modes = ("full", "crc", "checksum", "sparse", "none")
     parser.add_argument("-c", "--check", required=False, metavar="MODE",
                         default="none", choices=check_modes, help="""Checking
                         mode for written data. Known modes are: [%(choices)s].
@@ -471,8 +1045,31 @@ def create_parser():
                         is used. (default: %(default)s).""", type=constant)
 
     parser.add_argument("-b", "--blocksize", help="""Maximum blocksize to use
-                        for read operations (default: %(default)s).""",
-                        default="1M", type=constant)
+                        for write operations. When writing a file in the
+                        'sparse' or 'checksum' modes, this is only the size of
+                        the first load, and later loads can grow past it (see
+                        -l/--load-time). Use 'auto' to tune it from the
+                        measured throughput, starting from the value that was
+                        tuned for this target in an earlier run (default:
+                        %(default)s).""", default="1M", type=blocksize)
+
+    parser.add_argument("-q", "--queue-depth", metavar="DEPTH", help="""Number
+                        of blocks to read ahead of TRACE32 when loading
+                        non-seekable input in the 'sparse' or 'checksum'
+                        modes (default: %(default)s).""", default=2, type=int)
+
+    parser.add_argument("-l", "--load-time", metavar="SECONDS", help="""Target
+                        duration of each TRACE32 load when writing a file in
+                        the 'sparse' or 'checksum' modes. Loads start at
+                        BLOCKSIZE and grow until they take about this long.
+                        Use 0 for fixed-size loads (default: %(default)s).""",
+                        default=1.0, type=float)
+
+    parser.add_argument("-d", "--delta", action="store_true", help="""Only
+                        write blocks that differ from the target's current
+                        contents, by comparing a CRC32 of each block that's
+                        computed on the target. Can't be used with the
+                        'sparse' or 'checksum' modes.""")
 
     # ----------------------------------------------------------------------- #
 
@@ -491,16 +1088,82 @@ def create_parser():
     parser.add_argument("statement", metavar="STATEMENT", help="""Script file
                         to run (and arguments to provide to the script). If
                         used with -c/--command, all STATEMENT words are joined
-                        to make a single TRACE32 expression. """, nargs="+")
+                        to make a single TRACE32 expression. Use '-c -' to
+                        run a batch of commands read from stdin, one per
+                        line.""", nargs="+")
 
     # ----------------------------------------------------------------------- #
 
     parser = subparsers.add_parser("gdb", help="""Run GDB with a Trace32
                                    backend""", parents=child_common)
 
+    parser.description = """Serve TRACE32 to GDB as a remote-serial-protocol
+    stub. Connect to it from GDB with 'target remote HOST:PORT'. Memory reads
+    are cached while the target is halted. Only 32-bit ARM registers are
+    supported."""
+
+    parser.add_argument("-L", "--listen", metavar="[HOST]:PORT",
+                        type=listen_address, default="localhost:3333",
+                        help="""Address to listen for GDB connections on.
+                        The stub has no authentication, so it only listens
+                        on localhost unless HOST is given. Use '*:PORT' to
+                        listen on all interfaces (default: %(default)s).""")
+
+    parser.add_argument("--page-size", metavar="BYTES",
+                        type=constant, default="1k", help="""Size of each
+                        page in the memory cache. Must be a power of two
+                        (default: %(default)s).""")
+
+    # ----------------------------------------------------------------------- #
+
+    parser = subparsers.add_parser("bench", help="""Benchmark the link to
+                                   the target""", parents=child_common)
+
+    parser.description = """Measure read_memory/write_memory throughput
+    over a range of block sizes, and the latency of T32_Ping, T32_Nop,
+    run_command, eval_expression, and run_file. Results are written as JSON,
+    and a summary is logged. Works with '-p sim' when no hardware is
+    available. Memory at ADDRESS is overwritten during the write benchmark,
+    and restored afterwards."""
+
+    parser.add_argument("address", metavar="ADDRESS", help="""Start of a
+                        region of target memory to use for the throughput
+                        benchmarks.""", type=constant)
+
+    parser.add_argument("-o", "--outfile", help="""JSON file to write
+                        (default: stdout).""", type=path_writeable)
+
+    parser.add_argument("--sizes", metavar="SIZE[,SIZE...]",
+                        type=constant_list, default="4k,16k,64k,256k,1M,4M",
+                        help="""Block sizes to measure throughput with
+                        (default: %(default)s).""")
+
+    parser.add_argument("--total", metavar="BYTES", type=constant,
+                        default="4M", help="""Amount of data to move for
+                        each block size. This is also the size of the memory
+                        region that's used (default: %(default)s).""")
+
+    parser.add_argument("-n", "--count", metavar="N", type=int, default=200,
+                        help="""Number of samples for each latency
+                        measurement (default: %(default)s).""")
+
+    parser.add_argument("--read-only", action="store_true", help="""Skip
+                        the write benchmark, and leave target memory
+                        untouched.""")
+
+    # ----------------------------------------------------------------------- #
+
     parser = subparsers.add_parser("serve", help="""Run Trace32 as a headless
                                    server""", parents=child_common)
 
+    parser.description = """Launch TRACE32 and keep it connected in the
+    background. Other commands that find the server's socket reuse its
+    TRACE32 instance instead of launching their own. Header scripts run once
+    when the server starts, and footer scripts run when it stops."""
+
+    parser.add_argument("--stop", action="store_true", help="""Stop a
+                        running server instead of starting a new one.""")
+
     return top_parser
 
 
@@ -510,12 +1173,56 @@ def run_parser(parser):
 
     args = parser.parse_args()
 
+    if args.verbosity is None:
+        args.verbosity = 0
+
     if args.footer is None:
         args.footer = []
 
     if args.header is None:
         args.header = []
 
+    # A batch of commands is read from stdin up-front, so that it can be
+    # shared by multiple targets.
+
+    args.batch = None
+
+    if args.subcommand == 'run' and args.command:
+        if args.statement == ['-']:
+            cmds = [x.strip() for x in sys.stdin.read().splitlines()]
+            args.batch = [x for x in cmds if x and not x.startswith(';')]
+
+    if (args.subcommand == 'read') and args.verify_only:
+        if not args.reference:
+            msg = "--verify-only needs -r/--reference."
+            raise argparse.ArgumentError(None, msg)
+
+        if args.outfile:
+            msg = "--verify-only can't be used with -o/--outfile."
+            raise argparse.ArgumentError(None, msg)
+
+        args.check = "crc"
+
+    if (args.subcommand == 'write') and args.delta:
+        if args.check in ("sparse", "checksum"):
+            msg = f"-d/--delta can't be used with [{args.check}] mode."
+            raise argparse.ArgumentError(None, msg)
+
+    if args.subcommand == 'bench':
+        if args.count < 1:
+            msg = "-n/--count must be at least 1."
+            raise argparse.ArgumentError(None, msg)
+
+        if not args.sizes or min(args.sizes) < 1:
+            msg = "--sizes needs one or more block sizes, all above 0."
+            raise argparse.ArgumentError(None, msg)
+
+    if args.subcommand == 'gdb':
+        size = args.page_size
+        if (size <= 0) or (size & (size - 1)):
+            msg = "--page-size must be a power of two."
+            raise argparse.ArgumentError(None, msg)
+
     if (args.subcommand == 'write') and (args.check == 'checksum'):
         if args.scratchpad is None:
             msg = "SPADDRESS must be specified for 'checksum' validation mode."
@@ -541,7 +1248,7 @@ def _cli():
     parser = create_parser()
     args = run_parser(parser)
 
-    if (args.subcommand == 'read') and not args.outfile:
+    if (args.subcommand in ('read', 'bench')) and not args.outfile:
         args.logdest = sys.stderr
     else:
         args.logdest = sys.stdout
@@ -551,56 +1258,120 @@ def _cli():
     if args.subcommand is None:
         parser.error("COMMAND not specified.")
 
-    if args.subcommand in ['gdb', 'serve']:
-        parser.error(f"subcommand [{args.subcommand}] isn't implemented yet.")
+    args.progname = parser.prog
+
+    if args.socket is None:
+        args.socket = default_socket_path()
 
-    commands = {
-        'read': read,
-        'write': write,
-        'run': run
-    }
+    if args.subcommand == 'serve' and args.stop:
+        client = find_server(args.socket)
+        if client is None:
+            raise OSError(f"No server is running at {args.socket}")
 
-    args.progname = parser.prog
+        with client:
+            client.shutdown()
+
+        args.log("Server stopped OK.", level=1)
+        return None
+
+    if args.targets:
+        return _fan_out(args)
+
+    if args.subcommand != 'serve' and not is_loopback(args.libfile):
+        client = find_server(args.socket)
+        if client is not None:
+            args.log(f"Using TRACE32 server at [{args.socket}].", level=2)
+            _warn_server_options(args)
+            args.packlen = None
+
+            # Same as _launch(): a server on the loopback API gets no
+            # tuning profile.
+
+            if client.loopback:
+                args.profile = None
+            else:
+                args.profile = _tuning_profile(
+                    args, server_profile_key(args.socket))
+
+            with client:
+                return _run_session(args, client)
 
     if args.usb_reset:
         args.log("Resetting TRACE32 USB debugger.")
         usb_reset()
         args.log("Reset completed OK.", level=2)
 
-    if args.protocol.lower() == "usb":
-        sp_kwargs = {"podbus": Podbus.USB}
+    return _launch(args, args.t32bin, args.protocol)
+
+
+def _warn_server_options(args):
+    """ Warns about launch options that have no effect, because a running
+    server's TRACE32 instance is being used instead. """
+
+    ignored = []
+
+    if args.usb_reset:
+        ignored.append("-u/--usb-reset")
+
+    if args.protocol != "usb":
+        ignored.append("-p/--protocol")
+
+    if args.t32bin != "t32marm":
+        ignored.append("-t/--t32bin")
+
+    if args.packlen is not None:
+        ignored.append("--packlen")
+
+    if ignored:
+        args.log(f"Warning: ignoring {', '.join(ignored)}, since the "
+                 f"server's TRACE32 is already running.", level=0)
+
+
+def _launch(args, t32bin, protocol, serial=None):
+    """ Launches TRACE32, connects to it, and runs a session on it. Returns
+    the result of the session. """
+
+    if protocol.lower() == "usb":
+        podbus = Podbus.USB
     else:
-        sp_kwargs = {"sim": Podbus.SIM}
+        podbus = Podbus.SIM
+
+    # Rates measured on the loopback API say nothing about real hardware,
+    # so they're never saved to (or tuned from) a profile.
+
+    if is_loopback(args.libfile):
+        args.profile = None
+    else:
+        args.profile = _tuning_profile(args, profile_key(t32bin, protocol,
+                                                         serial))
+
+    if args.profile and args.packlen is None:
+        args.packlen = args.profile.best_packlen()
+        if args.packlen:
+            args.log(f"Using tuned PACKLEN of {args.packlen}.", level=2)
+
+    if is_loopback(args.libfile):
+        args.log("Connecting to the loopback API.", level=1)
+
+        with Trace32Interface(libfile=args.libfile, sequenced=True,
+                              packlen=args.packlen) as iface:
+            return _run_session(args, iface)
+
+    # The TRACE32 binary is only checked once it's about to be launched, so
+    # that servers and the loopback API work on machines without TRACE32.
+
+    t32bin = trace32_binary(t32bin)
 
     args.log("Launching TRACE32.")
-    with Trace32Subprocess(args.t32bin, **sp_kwargs) as proc:
+    with Trace32Subprocess(t32bin, podbus=podbus, serial=serial,
+                           libfile=args.libfile) as proc:
         args.log("TRACE32 launched OK.", level=2)
 
-        with Trace32Interface(port=proc.port, tempdir=proc.tempdir) as iface:
+        with Trace32Interface(libfile=args.libfile, port=proc.port,
+                              tempdir=proc.tempdir, sequenced=True,
+                              packlen=args.packlen) as iface:
             args.log("Remote interface connected OK.", level=2)
-
-            for script in args.header:
-                args.log(f"Running header script [{script}].")
-                start = time.monotonic()
-                iface.run_file(script, logfile=args.logdest)
-                stop = time.monotonic()
-                args.log("Header script completed OK.")
-                args.log("(runtime: %.2f sec)" % (stop - start), level=3)
-
-            args.log(f"Launching command [{args.subcommand}].", level=2)
-            start = time.monotonic()
-            result = commands[args.subcommand](args, iface)
-            stop = time.monotonic()
-            args.log(f"Command [{args.subcommand}] completd OK.", level=2)
-            args.log("(runtime: %.2f sec)" % (stop - start), level=3)
-
-            for script in args.footer:
-                args.log(f"Running footer script [{script}].")
-                start = time.monotonic()
-                iface.run_file(script, logfile=args.logdest)
-                stop = time.monotonic()
-                args.log("Footer script completed OK.")
-                args.log("(runtime: %.2f sec)" % (stop - start), level=3)
+            result = _run_session(args, iface)
 
         args.log("Disconnected OK.", level=2)
         args.log("Terminating TRACE32.", level=2)
@@ -609,6 +1380,118 @@ def _cli():
     return result
 
 
+def _tuning_profile(args, key):
+    """ Returns the tuning Profile for this command and profile key, or None
+    if the command isn't using '--blocksize auto'. """
+
+    if getattr(args, 'blocksize', None) != "auto":
+        return None
+
+    return Profile(key, args.subcommand)
+
+
+def _fan_out(args):
+    """ Runs the requested command on every target listed in args.targets
+    in parallel, and prints a table of the results. Raises an error if any of
+    the targets failed. """
+
+    if args.subcommand not in ('write', 'run'):
+        msg = f"-T/--targets can't be used with [{args.subcommand}]."
+        raise argparse.ArgumentError(None, msg)
+
+    targets = load_targets(args.targets, args.protocol, args.t32bin)
+
+    if args.usb_reset:
+        args.log("Resetting TRACE32 USB debuggers.")
+        usb_reset()
+        args.log("Reset completed OK.", level=2)
+
+    args.log(f"Running [{args.subcommand}] on {len(targets)} targets.")
+
+    # Workers get a copy of the arguments without the parent's open files and
+    # logger. Input that can only be read once is spooled to a file first.
+
+    job = argparse.Namespace(**vars(args))
+    del job.log, job.logdest
+
+    with make_tempdir() as tempdir:
+        if args.subcommand == 'write':
+            if os.path.isfile(getattr(args.infile, 'name', '')):
+                job.infile = os.path.abspath(args.infile.name)
+            else:
+                job.infile = spool(args.infile, tempdir)
+
+        results = fan_out(_fan_out_target, targets, job, args.logdest)
+
+    for line in format_results(results):
+        args.log(line, level=0)
+
+    failures = [x for x in results if x.error is not None]
+
+    if failures:
+        msg = f"{len(failures)} of {len(results)} targets failed."
+        raise RuntimeError(msg)
+
+    return None
+
+
+def _fan_out_target(target, args, logfile):
+    """ Worker for _fan_out(). Runs a full session on a single target,
+    logging to 'logfile'. """
+
+    args.logdest = logfile
+    args.log = create_commenter(args.verbosity, dest=logfile)
+
+    if args.subcommand == 'write':
+        # pylint: disable=consider-using-with
+        args.infile = open(args.infile, 'rb')
+
+    try:
+        return _launch(args, target.t32bin, target.protocol, target.serial)
+    finally:
+        if args.subcommand == 'write':
+            args.infile.close()
+
+
+def _run_session(args, iface):
+    """ Runs the header scripts, the requested command, and the footer
+    scripts on a connected interface. Returns the result of the command. """
+
+    commands = {
+        'read': read,
+        'write': write,
+        'run': run,
+        'serve': serve,
+        'gdb': gdb,
+        'bench': bench
+    }
+
+    for script in args.header:
+        args.log(f"Running header script [{script}].")
+        start = time.monotonic()
+        iface.run_file(script, logfile=args.logdest)
+        stop = time.monotonic()
+        args.log("Header script completed OK.")
+        args.log("(runtime: %.2f sec)" % (stop - start), level=3)
+
+    args.log(f"Launching command [{args.subcommand}].", level=2)
+    start = time.monotonic()
+    result = commands[args.subcommand](args, iface)
+    stop = time.monotonic()
+    args.log(f"Command [{args.subcommand}] completd OK.", level=2)
+    args.log("(runtime: %.2f sec)" % (stop - start), level=3)
+
+    for script in args.footer:
+        args.log(f"Running footer script [{script}].")
+        start = time.monotonic()
+        iface.run_file(script, logfile=args.logdest)
+        stop = time.monotonic()
+        args.log("Footer script completed OK.")
+        args.log("(runtime: %.2f sec)" % (stop - start), level=3)
+
+    return result
+
+
 def main():
     """ Main function for launching the CLI. """
 